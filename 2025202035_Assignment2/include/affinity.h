@@ -0,0 +1,20 @@
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+#include <vector>
+// CPU and NUMA placement of jobs (Linux): `pin --cpus 2-3 cmd`,
+// `pin --node 1 cmd`, `pin --spread --cpus 4-7 a | b | c`. The forked
+// child sets its own affinity and memory policy before exec, so pinning
+// costs no extra exec per stage.
+struct Placement {
+    std::vector<int> cpus; // ascending; empty: inherit the shell's
+    int node = -1;         // bind memory to this node (set_mempolicy)
+    bool spread = false;   // stage i runs on cpus[i % n] alone
+};
+// Parses --cpus/--node/--spread from args[1...]; returns the index of the
+// first other word, -1 after reporting an error. The CPU list is checked
+// against the CPUs the shell may use.
+int placement_parse(char** args, Placement& pl, const char* who);
+void placement_apply(const Placement& pl, int stage); // in the child
+int builtin_pin(char** args);                         // `pin` without a command
+#endif
@@ -0,0 +1,12 @@
+
+#ifndef ARITH_H
+#define ARITH_H
+#include <cstddef>
+#include <cstdint>
+// Integer arithmetic for $(( )) and let: 64-bit, C operator precedence,
+// shell variables by bare name, assignments (= += ... ++ --). Evaluation
+// works in place on the text and doesn't allocate.
+// Returns false with *err set to a static message on failure.
+bool arith_eval(const char* expr, size_t len, int64_t& result, const char** err);
+int builtin_let(char** args);
+#endif
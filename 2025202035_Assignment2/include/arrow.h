@@ -4,6 +4,11 @@
 #include <string>
 #include <vector>
 std::string read_input_line();
+bool read_continuation_line(std::string& line);
+// Reactor signal actions while a line is being read
+void input_interrupted();
+void input_resized();
+void input_print_above(const std::string& text);
 void load_history();
 void save_history();
 const std::vector<std::string>& get_history();
@@ -0,0 +1,18 @@
+
+#ifndef BGSCHED_H
+#define BGSCHED_H
+#include <sys/types.h>
+// Scheduling policy for background jobs (Linux). $BG_SCHED lists what a job
+// started with & (or continued with bg) gets: nice=N, io=idle|be:N,
+// cpu=idle|batch, or off. Unset means "nice=10". The child applies it to
+// itself before exec; fg puts the job back to the shell's own priority.
+struct BgPolicy {
+    int nice = -1;   // -1: leave alone
+    int ioprio = -1; // ioprio_set value
+    int policy = -1; // SCHED_IDLE / SCHED_BATCH
+};
+bool bgsched_policy(BgPolicy& pol);              // false when off
+void bgsched_apply(const BgPolicy& pol, pid_t pid); // 0: the calling process
+bool bgsched_demote(pid_t pgid);                 // a running job (bg); false when off
+bool bgsched_promote(pid_t pgid);                // fg; false if not allowed
+#endif
@@ -11,5 +11,11 @@ int builtin_ls(char** args);
 int builtin_pinfo(char** args);
 int builtin_search(char** args);
 int builtin_history(char** args);
+int builtin_enable(char** args);
+int builtin_test(char** args);  // test and [
+int builtin_true(char** args);
+int builtin_false(char** args);
 int builtin_dispatch(char** argv);
+int builtin_flags(const char* cmd); // MYSH_BI_* bits, 0 if not a builtin
+std::vector<std::string> builtin_names();
 #endif
@@ -0,0 +1,27 @@
+
+#ifndef CGROUP_H
+#define CGROUP_H
+#include <string>
+#include <sys/types.h>
+// Per-job cgroup v2 control (Linux). A job started under `limit` gets its
+// own child cgroup below the shell's delegated subtree (the shell's cgroup,
+// or $MYSH_CGROUP). Each forked child joins it before doing anything
+// else, so the command never runs outside the limits.
+struct CgLimits {
+    long long cpu_weight = 0; // 1..10000
+    long long cpu_max = 0;    // percent of one CPU
+    long long mem_max = 0;    // bytes, -1 for "max"
+    long long pids_max = 0;   // -1 for "max"
+};
+// Parses --cpu-weight/--cpu-max/--mem-max/--pids-max from args[1...];
+// returns the index of the first other word, -1 after reporting an error.
+int cgroup_parse_limits(char** args, CgLimits& lim, const char* who);
+// A new, empty job cgroup with the limits written; "" after reporting why not.
+std::string cgroup_create(const CgLimits& lim, const char* who);
+bool cgroup_apply(const std::string& dir, const CgLimits& lim, const char* who);
+int cgroup_open(const std::string& dir);   // directory fd for cgroup_fork
+pid_t cgroup_fork(int cgfd);               // fork(), into cgfd when >= 0
+bool cgroup_adopt(const std::string& dir, pid_t pgid); // move a running job
+void cgroup_release(const std::string& dir);          // rmdir once empty
+std::string cgroup_stats(const std::string& dir);     // cpu.stat / memory.current summary
+#endif
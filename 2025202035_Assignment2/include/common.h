@@ -9,4 +9,5 @@ extern pid_t FG_PGID;
 string tildeify(const string& p);
 string trim(const string& s);
 vector<string> split_simple(const std::string& s, char delim);
+string human_bytes(double bytes); // 512B, 1.5K, 12.0M
 #endif
@@ -0,0 +1,22 @@
+
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <ctime>
+// Shared directory listings for completion, ls and globbing. Entries are
+// keyed by (dev, ino) and reused while the directory's mtime/ctime are
+// unchanged, so a repeated listing costs one stat() and no getdents.
+// On Linux an inotify watch also drops a listing as soon as it changes.
+struct DirEntry {
+    std::string name;
+    unsigned char type; // d_type, DT_UNKNOWN when the filesystem has none
+};
+typedef std::shared_ptr<const std::vector<DirEntry>> DirListing;
+// Entries of `path` without "." and "..", or nullptr with errno set.
+DirListing dir_entries(const std::string& path);
+// Adopt a listing read elsewhere; `st` must come from before the read.
+void dir_cache_insert(const std::string& path, const struct stat& st, const struct timespec& read_at, DirListing entries);
+#endif
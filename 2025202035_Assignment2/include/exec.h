@@ -2,6 +2,9 @@
 #ifndef EXEC_H
 #define EXEC_H
 #include "parser.h"
-void run_parsed(Parsed& p);
+int run_parsed(Parsed& p); // returns exit status
 std::string build_cmd_string(const Parsed& p);
+// In a forked subshell (`&` compound, process substitution): commands it
+// runs stay in its process group, so signals to the job reach them.
+void exec_in_subshell();
 #endif
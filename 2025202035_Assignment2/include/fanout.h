@@ -0,0 +1,16 @@
+
+#ifndef FANOUT_H
+#define FANOUT_H
+#include "pipemeter.h"
+#include <memory>
+#include <string>
+#include <vector>
+// Fan-out (`cmd |{ a ; b ; c }`). A shell thread copies the producer's pipe
+// into one pipe per branch with tee(2), which shares the pages instead of
+// copying them, then drops the consumed bytes. By default it waits for the
+// slowest branch; with FANOUT=drop a branch whose pipe is full misses that
+// chunk instead (counted as dropped).
+// The relay owns and closes in_fd and every out fd.
+std::vector<std::shared_ptr<HopStats>> fanout_start(int in_fd, const std::vector<int>& outs,
+                                                    const std::vector<std::string>& labels, bool drop);
+#endif
@@ -0,0 +1,19 @@
+
+#ifndef FRAME_H
+#define FRAME_H
+#include <string>
+#include <cstdint>
+// Framing for --server: 1 type byte, 4-byte big-endian length, payload.
+enum FrameType : char {
+    FRAME_CMD    = 'C', // client -> server: one or more command lines
+    FRAME_STDOUT = 'O', // server -> client: stdout chunk
+    FRAME_STDERR = 'E', // server -> client: stderr chunk
+    FRAME_EXIT   = 'X'  // server -> client: 4-byte big-endian exit status
+};
+// Largest payload either side accepts; a longer header ends the connection.
+static const uint32_t FRAME_MAX = 16u << 20;
+bool write_frame(int fd, char type, const char* data, uint32_t len);
+bool write_exit_frame(int fd, int status);
+bool read_frame(int fd, char& type, std::string& payload);
+int exit_frame_status(const std::string& payload);
+#endif
@@ -0,0 +1,23 @@
+
+#ifndef FUZZY_H
+#define FUZZY_H
+#include <cstdint>
+#include <string>
+#include <vector>
+// Fuzzy (subsequence) matching with fzf-style scoring. Candidates are
+// indexed once; each query scans a packed array of character-set masks to
+// drop impossible candidates before any per-character work, and large sets
+// are scored on several threads.
+int fuzzy_score(const std::string& pattern, const std::string& text); // -1 if no match
+
+class FuzzyIndex {
+public:
+    void assign(std::vector<std::string> cands);
+    const std::vector<std::string>& candidates() const { return cands; }
+    // Best `limit` matches, highest score first.
+    std::vector<std::string> rank(const std::string& pattern, size_t limit) const;
+private:
+    std::vector<std::string> cands;
+    std::vector<uint64_t> masks;
+};
+#endif
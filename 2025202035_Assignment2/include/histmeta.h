@@ -0,0 +1,129 @@
+
+#ifndef HISTMETA_H
+#define HISTMETA_H
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+// History sidecar file format, shared by both shells: AOS_A2/include/histmeta.h
+// only includes this file, so there is one layout to change.
+//
+// "MYSHHM1\n", then records: a fixed head followed by the command and cwd
+// bytes. Records are appended with a single O_APPEND write under flock(), so
+// several shells can share the file. Past META_MAX_RECS a load keeps the
+// newest half: it rereads the file and renames the compacted copy over it
+// while holding the lock, and an appender that then finds it has the old
+// file reopens it.
+struct RecHead {
+    uint32_t start;   // unix time
+    uint32_t dur_ms;
+    uint32_t rss_kb;  // 0: nothing was forked
+    uint16_t cmd_len;
+    uint16_t cwd_len;
+    uint8_t status;
+    uint8_t pad[3];
+};
+static_assert(sizeof(RecHead) == 20, "history sidecar layout");
+static const char META_MAGIC[8] = {'M', 'Y', 'S', 'H', 'H', 'M', '1', '\n'};
+static const size_t META_MAX_RECS = 20000;
+
+struct Rec {
+    RecHead h;
+    std::string cmd, cwd;
+};
+
+inline Rec meta_rec(const std::string& cmd, const std::string& cwd, time_t start, double secs, int status,
+                    long peak_kb) {
+    Rec r;
+    memset(&r.h, 0, sizeof(r.h));
+    r.cmd = cmd.substr(0, UINT16_MAX);
+    r.cwd = cwd.substr(0, UINT16_MAX);
+    r.h.start = (uint32_t)start;
+    r.h.dur_ms = (uint32_t)std::min(secs * 1000 + 0.5, (double)UINT32_MAX);
+    r.h.rss_kb = (uint32_t)std::max(0L, peak_kb);
+    r.h.cmd_len = (uint16_t)r.cmd.size();
+    r.h.cwd_len = (uint16_t)r.cwd.size();
+    r.h.status = (uint8_t)status;
+    return r;
+}
+
+inline std::string meta_encode(const Rec& r) {
+    std::string out((const char*)&r.h, sizeof(r.h));
+    return out + r.cmd + r.cwd;
+}
+
+// Every record in the file open on fd, from the start.
+inline std::vector<Rec> meta_read(int fd) {
+    std::vector<Rec> out;
+    std::string data;
+    struct stat sb;
+    if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+        data.resize((size_t)sb.st_size);
+        size_t got = 0;
+        ssize_t r;
+        while (got < data.size() && (r = pread(fd, &data[got], data.size() - got, (off_t)got)) > 0) got += (size_t)r;
+        data.resize(got);
+    }
+    if (data.size() < sizeof(META_MAGIC) || memcmp(data.data(), META_MAGIC, sizeof(META_MAGIC)) != 0) return out;
+    for (size_t off = sizeof(META_MAGIC); off + sizeof(RecHead) <= data.size();) {
+        Rec r;
+        memcpy(&r.h, data.data() + off, sizeof(r.h));
+        off += sizeof(r.h);
+        if (off + r.h.cmd_len + r.h.cwd_len > data.size()) break; // torn write
+        r.cmd.assign(data, off, r.h.cmd_len);
+        r.cwd.assign(data, off + r.h.cmd_len, r.h.cwd_len);
+        off += r.h.cmd_len + r.h.cwd_len;
+        out.push_back(std::move(r));
+    }
+    return out;
+}
+
+// Whether fd is still the file at path (not replaced by a compaction).
+inline bool meta_is_current(int fd, const std::string& path) {
+    struct stat a, b;
+    return fstat(fd, &a) == 0 && stat(path.c_str(), &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+// All records at path, compacting the file first when it has grown too long.
+inline std::vector<Rec> meta_load(const std::string& path) {
+    std::vector<Rec> recs;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return recs;
+    recs = meta_read(fd);
+    if (recs.size() > META_MAX_RECS && flock(fd, LOCK_EX) == 0 && meta_is_current(fd, path)) {
+        recs = meta_read(fd); // with whatever was appended before we got the lock
+        if (recs.size() > META_MAX_RECS) recs.erase(recs.begin(), recs.end() - META_MAX_RECS / 2);
+        std::string tmp = path + ".tmp";
+        std::string out(META_MAGIC, sizeof(META_MAGIC));
+        for (auto& r : recs) out += meta_encode(r);
+        int w = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (w >= 0) {
+            bool ok = write(w, out.data(), out.size()) == (ssize_t)out.size();
+            close(w);
+            if (!ok || rename(tmp.c_str(), path.c_str()) < 0) unlink(tmp.c_str());
+        }
+    }
+    close(fd); // drops the lock
+    return recs;
+}
+
+inline void meta_append(const std::string& path, const Rec& r) {
+    for (int tries = 0; tries < 3; tries++) {
+        int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) break;
+        if (flock(fd, LOCK_EX) == 0 && !meta_is_current(fd, path)) { close(fd); continue; } // compacted meanwhile
+        struct stat sb;
+        std::string out = fstat(fd, &sb) == 0 && sb.st_size == 0 ? std::string(META_MAGIC, sizeof(META_MAGIC)) : "";
+        out += meta_encode(r);
+        (void)!write(fd, out.data(), out.size());
+        close(fd);
+        break;
+    }
+}
+#endif
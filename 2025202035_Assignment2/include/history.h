@@ -1,5 +1,13 @@
 
 #ifndef HISTORY_H
 #define HISTORY_H
+#include <string>
+#include <ctime>
 int show_history_builtin(char** args);
+// Per-command records in a binary sidecar next to the text history
+// (~/.mysh_history_child.meta): start time, duration, exit status, cwd and
+// peak RSS. Appended one record per write; read once and indexed in memory
+// for `history --slowest/--failed/--stats`.
+void history_record(const std::string& cmd, const std::string& cwd, time_t start, double secs, int status,
+                    long peak_kb);
 #endif
@@ -0,0 +1,11 @@
+
+#ifndef INTERP_H
+#define INTERP_H
+#include "parser.h"
+// Tree-walking interpreter for parse_script() output. Lists, && ||,
+// if/while/until/for, break/continue/exit and builtins all run in the shell
+// process; only external commands fork. A compound ending in & runs in a
+// forked subshell as one job.
+int run_tree(const Node& root);  // status of the last command run
+bool exit_requested();           // `exit` ran; run_tree returned its status
+#endif
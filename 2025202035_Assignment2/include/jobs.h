@@ -0,0 +1,29 @@
+
+#ifndef JOBS_H
+#define JOBS_H
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+// Job table. Every pipeline gets a job; background and stopped ones stay
+// listed. A finished background job is reported as soon as its SIGCHLD
+// reaches the reactor, above the line being typed (without the reactor:
+// before the next prompt).
+int job_add(pid_t pgid, pid_t last_pid, int nprocs, const std::string& cmd);
+void job_set_cgroup(int id, const std::string& dir);
+struct HopStats;
+void job_set_meters(int id, const std::vector<std::shared_ptr<HopStats>>& meters); // |> hops
+void job_set_demoted(int id); // started under $BG_SCHED; fg restores it
+int job_wait_fg(int id);  // returns the shell status of the job
+// In a forked child that runs commands of its own (subshell, server
+// session): start from an empty table owned by this process.
+void jobs_own();
+void jobs_reap();         // collect background state changes, never blocks
+void jobs_notify();       // print what jobs_reap found
+long jobs_peak_rss();     // peak RSS (KiB) of processes reaped since the last call
+int builtin_jobs(char** args);
+int builtin_fg(char** args);
+int builtin_bg(char** args);
+int builtin_limit(char** args);
+int builtin_renice(char** args);
+#endif
@@ -0,0 +1,28 @@
+
+#ifndef MYSH_BUILTIN_H
+#define MYSH_BUILTIN_H
+/* Stable C ABI for loadable builtins (`enable -f lib.so name`).
+ * A plugin exports one `struct mysh_builtin mysh_builtin_<name>` per builtin. */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MYSH_BUILTIN_ABI 1
+
+enum {
+    MYSH_BI_PARENT   = 1, /* may run inside the shell process when standalone */
+    MYSH_BI_PIPELINE = 2  /* may run in a forked pipeline stage */
+};
+
+struct mysh_builtin {
+    int abi;                            /* MYSH_BUILTIN_ABI */
+    const char* name;
+    int flags;                          /* MYSH_BI_* */
+    int (*fn)(int argc, char** argv);   /* returns exit status */
+    const char* help;
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
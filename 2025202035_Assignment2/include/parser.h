@@ -5,14 +5,50 @@
 #include <vector>
 struct CmdStage {
     std::vector<char*> argv;
+    std::vector<std::string> assigns; // leading VAR=value words
     std::string infile;
     std::string outfile;
     bool append = false;
+    std::string here_delim;   // <<DELIM as written, for display
+    std::string here_body;    // here-doc / here-string contents
+    bool has_here = false;
+    bool here_expand = true;  // false when the delimiter was quoted
+    bool meter = false;       // |> into the next stage: relayed and counted by the shell
 };
 struct Parsed {
     std::vector<CmdStage> stages;
+    std::vector<Parsed> fanout;   // cmd |{ a ; b }: each consumer reads a copy of the output
     bool background = false;
 };
-std::vector<Parsed> parse_line_strtok(const std::string& line);
+
+// Command tree: pipelines joined by ; && || and nested in if/while/until/for.
+enum NodeKind { N_PIPELINE, N_LIST, N_ANDOR, N_NOT, N_IF, N_WHILE, N_UNTIL, N_FOR };
+struct Node {
+    NodeKind kind = N_LIST;
+    Parsed cmd;                     // N_PIPELINE
+    std::vector<Node> kids;         // list items; and/or: the pipelines; not: one;
+                                    // if: cond, then, [cond, then]..., [else];
+                                    // while/until: cond, body; for: body
+    std::string ops;                // N_ANDOR: '&' or '|' between kids[k] and kids[k+1]
+    bool has_else = false;          // N_IF
+    bool background = false;        // list item ended with &
+    std::string var;                // N_FOR
+    std::vector<std::string> words; // N_FOR, before expansion
+};
+
+// parse_script never builds a tree deeper than this; the script cache
+// treats anything deeper as corrupt.
+const int NODE_DEPTH_MAX = 256;
+
+enum ParseStatus { PARSE_OK, PARSE_MORE, PARSE_ERROR };
+// Parse a block of text (one or more lines). PARSE_MORE: the text ends
+// inside a compound command, after && || |, or in a here-doc body; with
+// at_eof the text is complete, so that is a syntax error instead (a
+// here-doc may still end at end of file).
+ParseStatus parse_script(const std::string& text, Node& out, std::string& err, bool at_eof);
+// '<' or '>' for a process substitution word <(cmd) / >(cmd), else 0.
+char procsub_kind(const char* w);
+Parsed copy_parsed(const Parsed& p);
 void free_parsed(Parsed& p);
+void free_tree(Node& n);
 #endif
@@ -0,0 +1,22 @@
+
+#ifndef REACTOR_H
+#define REACTOR_H
+#include <functional>
+// Event loop for the interactive shell. Terminal input, registered fds and
+// signals (SIGCHLD, SIGINT, SIGTSTP, SIGWINCH) are all dispatched from
+// reactor_run_once(), in normal context: the signals are blocked and read
+// through a signalfd (Linux; a self-pipe elsewhere), so no handler runs
+// asynchronously.
+bool reactor_init();
+bool reactor_active();
+void reactor_add_fd(int fd, std::function<void()> on_readable);
+void reactor_remove_fd(int fd);
+void reactor_on_signal(int signo, std::function<void()> fn);
+// Waits up to timeout_ms (-1: no limit) and runs the handlers that are due.
+void reactor_run_once(int timeout_ms);
+// In a forked child: restore the signal mask and dispositions for exec;
+// the child no longer uses the reactor.
+void reactor_child_reset();
+// Terminal width, refreshed on SIGWINCH instead of an ioctl per use.
+int term_cols();
+#endif
@@ -0,0 +1,11 @@
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+#include "parser.h"
+#include <string>
+// Run a block of command lines; here-doc bodies come from the following lines.
+int run_script(const std::string& text);
+bool compile_script(const std::string& text, Node& out); // reports syntax errors
+// `mysh file`: like run_script, with the parse kept in the .myshc cache.
+int run_script_file(const std::string& path);
+#endif
@@ -0,0 +1,16 @@
+
+#ifndef SCRIPTCACHE_H
+#define SCRIPTCACHE_H
+#include "parser.h"
+#include <string>
+#include <sys/stat.h>
+// Compiled script cache (.myshc). The command tree of a script file is
+// stored under the cache directory, keyed by the script's path, size and
+// mtime and by the shell binary. A hit maps the file and decodes the tree
+// from it directly; the script is neither read nor lexed.
+// MYSH_SCRIPT_CACHE=off disables it, MYSH_CACHE_DIR moves it.
+bool script_cache_enabled();
+bool script_cache_load(const std::string& path, const struct stat& st, Node& out);
+void script_cache_store(const std::string& path, const struct stat& st, const Node& root);
+int script_cache_report();  // mysh --cache-stats
+#endif
@@ -0,0 +1,8 @@
+
+#ifndef SERVER_H
+#define SERVER_H
+#include <string>
+// `mysh --server PATH`: run command lines sent over a Unix socket.
+// With zygote_workers > 0 each session starts its own zygote.
+int run_server(const std::string& path, int zygote_workers = 0);
+#endif
@@ -4,16 +4,19 @@
 #include <string>
 #include <vector>
 #include <sys/types.h>
+#include <csignal>
 
 using namespace std;
 
 // Global vars
 extern string SHELL_HOME;
 extern pid_t FG_PGID;  
+extern volatile sig_atomic_t SHELL_INTERRUPTED;
 
 // Functions
 void sigint_handler(int);
 void sigtstp_handler(int);
 void install_shell_signal_handlers();
+void install_reactor_signal_handlers();
 
 #endif
\ No newline at end of file
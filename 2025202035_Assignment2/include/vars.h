@@ -0,0 +1,22 @@
+
+#ifndef VARS_H
+#define VARS_H
+#include <string>
+#include <vector>
+// Shell variables. Exported ones are mirrored into a cached envp block
+// that is only rebuilt after an export changes.
+void vars_init(char** envp);
+const char* var_get(const std::string& name);
+void var_set(const std::string& name, const std::string& value, bool exported = false);
+void var_unset(const std::string& name);
+void var_export(const std::string& name);
+bool is_assignment(const char* tok);
+// unquote: also drop the word's own '...' and "..." quotes, after expansion
+// (quotes that come out of a variable's value stay).
+std::string expand_vars(const std::string& word, bool unquote = false);
+size_t arith_end(const std::string& s, size_t from); // end of $(( ... ))
+char** env_block();
+char** env_with_overrides(const std::vector<std::string>& assigns, std::vector<char*>& scratch);
+int builtin_export(char** args);
+int builtin_unset(char** args);
+#endif
@@ -0,0 +1,18 @@
+
+#ifndef WARMUP_H
+#define WARMUP_H
+#include <string>
+#include <vector>
+#include "dircache.h"
+// Startup warm-up: a background thread reads the PATH directories and
+// builds the executable index while the first prompt is up. The main thread
+// adopts the result with a try_lock (when idle, or at the first command), so
+// it never waits for the thread.
+void warmup_start();
+// Main thread: adopt finished warm-up work, if any. True once adopted.
+bool warmup_poll();
+// Executables of a listing the warm-up read, or nullptr.
+const std::vector<std::string>* warm_execs(const DirListing& listing);
+// Full path of `name` from the index for the current PATH, or nullptr.
+const char* path_resolve(const char* name);
+#endif
@@ -0,0 +1,11 @@
+
+#ifndef WILDCARD_H
+#define WILDCARD_H
+#include <string>
+#include <vector>
+// Pathname expansion for *, ?, [...] and **. A pattern is compiled once,
+// each directory is read once, and results come back sorted.
+bool has_glob_meta(const std::string& word);
+bool glob_match(const std::string& pattern, const std::string& name);
+std::vector<std::string> glob_expand(const std::string& pattern);
+#endif
@@ -0,0 +1,15 @@
+
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+#include <sys/types.h>
+// Optional pre-forked launcher (Linux). A small helper keeps N children
+// parked on a control socket; an exec request is handed to a parked child
+// instead of forking the shell. Parked children are created as children of
+// the shell (CLONE_PARENT), so waitpid works as usual.
+bool zygote_start(int nworkers);
+bool zygote_active();
+// In a forked subshell: its launches would not be its own children.
+void zygote_detach();
+// Returns the pid of the launched process, or -1 to fall back to fork().
+pid_t zygote_spawn(char* const argv[], char* const envp[], int fd_in, int fd_out, int fd_err, pid_t pgid);
+#endif
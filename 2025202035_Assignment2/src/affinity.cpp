@@ -0,0 +1,131 @@
+#include "affinity.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+using namespace std;
+
+#ifdef __linux__
+// "0-3,8,10-11"
+static bool parse_cpu_list(const string& s, vector<int>& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == string::npos) comma = s.size();
+        string item = s.substr(pos, comma - pos);
+        pos = comma + 1;
+        char* end;
+        long a = strtol(item.c_str(), &end, 10), b = a;
+        if (end == item.c_str()) return false;
+        if (*end == '-') {
+            const char* hi = end + 1;
+            b = strtol(hi, &end, 10);
+            if (end == hi) return false;
+        }
+        if (*end || a < 0 || b < a || b >= CPU_SETSIZE) return false;
+        for (long c = a; c <= b; c++) out.push_back((int)c);
+    }
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+    return !out.empty();
+}
+
+static bool node_cpus(int node, vector<int>& out) {
+    char path[80];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char buf[4096] = "";
+    bool ok = fgets(buf, sizeof(buf), f) != nullptr;
+    fclose(f);
+    string list = buf;
+    while (!list.empty() && (list.back() == '\n' || list.back() == ' ')) list.pop_back();
+    if (!ok || list.empty()) { out.clear(); return true; } // memory-only node
+    return parse_cpu_list(list, out);
+}
+
+int placement_parse(char** args, Placement& pl, const char* who) {
+    int i = 1;
+    bool have_cpus = false;
+    for (; args[i]; i++) {
+        const char* opt = args[i];
+        if (strcmp(opt, "--") == 0) { i++; break; }
+        if (strncmp(opt, "--", 2) != 0) break;
+        if (strcmp(opt, "--spread") == 0) { pl.spread = true; continue; }
+        bool cpus = strcmp(opt, "--cpus") == 0;
+        if (!cpus && strcmp(opt, "--node") != 0) { cerr << who << ": " << opt << ": unknown option\n"; return -1; }
+        if (!args[i + 1]) { cerr << who << ": " << opt << ": value expected\n"; return -1; }
+        const char* v = args[++i];
+        if (cpus) {
+            if (!parse_cpu_list(v, pl.cpus)) { cerr << who << ": --cpus: invalid CPU list `" << v << "'\n"; return -1; }
+            have_cpus = true;
+        } else {
+            char* end;
+            long n = strtol(v, &end, 10);
+            if (end == v || *end || n < 0 || n >= 1024) { cerr << who << ": --node: invalid node `" << v << "'\n"; return -1; }
+            pl.node = (int)n;
+        }
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) { perror("sched_getaffinity"); return -1; }
+    if (pl.node >= 0) {
+        vector<int> on_node;
+        if (!node_cpus(pl.node, on_node)) { cerr << who << ": --node " << pl.node << ": no such NUMA node\n"; return -1; }
+        if (!have_cpus) { // the node's CPUs, those the shell may use
+            pl.cpus.clear();
+            for (int c : on_node) if (CPU_ISSET(c, &allowed)) pl.cpus.push_back(c);
+            if (pl.cpus.empty() && !on_node.empty()) { cerr << who << ": --node " << pl.node << ": none of its CPUs are allowed\n"; return -1; }
+        }
+    }
+    for (int c : pl.cpus) {
+        if (!CPU_ISSET(c, &allowed)) { cerr << who << ": CPU " << c << " is not available\n"; return -1; }
+    }
+    if (pl.spread && pl.cpus.empty()) {
+        for (int c = 0; c < CPU_SETSIZE; c++) if (CPU_ISSET(c, &allowed)) pl.cpus.push_back(c);
+    }
+    return i;
+}
+
+void placement_apply(const Placement& pl, int stage) {
+    if (!pl.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pl.spread) CPU_SET(pl.cpus[(size_t)stage % pl.cpus.size()], &set); // neighbours share caches
+        else for (int c : pl.cpus) CPU_SET(c, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) { perror("pin: sched_setaffinity"); _exit(126); }
+    }
+    if (pl.node >= 0) {
+        const int bits = 8 * sizeof(unsigned long);
+        unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+        mask[pl.node / bits] |= 1UL << (pl.node % bits);
+        if (syscall(SYS_set_mempolicy, MPOL_BIND, mask, (unsigned long)(sizeof(mask) * 8)) < 0 && errno != ENOSYS) {
+            perror("pin: set_mempolicy");
+            _exit(126);
+        }
+    }
+}
+#else
+int placement_parse(char**, Placement&, const char* who) {
+    cerr << who << ": CPU placement needs Linux\n";
+    return -1;
+}
+void placement_apply(const Placement&, int) {}
+#endif
+
+int builtin_pin(char** args) {
+    (void)args;
+    cerr << "usage: pin [--cpus LIST] [--node N] [--spread] cmd...\n";
+    return 2;
+}
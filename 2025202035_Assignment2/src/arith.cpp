@@ -0,0 +1,328 @@
+#include "arith.h"
+#include "vars.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+// Reused for every variable lookup and store, so steady-state evaluation
+// never touches the heap.
+static string name_buf, value_buf;
+
+enum { OP_NONE, OP_OROR, OP_ANDAND, OP_OR, OP_XOR, OP_AND, OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+       OP_SHL, OP_SHR, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_POW };
+static const int op_prec[] = {0, 1, 2, 3, 4, 5, 6, 6, 7, 7, 7, 7, 8, 8, 9, 9, 10, 10, 10, 11};
+
+// ASCII classes without the locale lookups of <cctype>
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+static bool name_start(char c) { char l = (char)(c | 0x20); return (l >= 'a' && l <= 'z') || c == '_'; }
+static bool name_char(char c) { return name_start(c) || is_digit(c); }
+
+// Precedence climbing over the text in [p, end). `skip` counts untaken
+// branches of && || ?:, where assignments and division errors are ignored.
+// `nest` bounds the recursion of ( ), unary operators and right-nested
+// operators, so a deep expression fails instead of overflowing the stack.
+struct Arith {
+    const char* p;
+    const char* end;
+    int depth;
+    int skip = 0;
+    const char* err = nullptr;
+    int nest = 0;
+
+    int64_t fail(const char* m) { if (!err) err = m; return 0; }
+    bool deeper() {
+        if (nest < 1024) { ++nest; return true; }
+        fail("expression recursion level exceeded");
+        return false;
+    }
+    void ws() { while (p < end && is_space(*p)) ++p; }
+    bool at(char c) { ws(); return p < end && *p == c; }
+
+    const char* name(size_t& len) {
+        const char* s = p;
+        while (p < end && name_char(*p)) ++p;
+        len = (size_t)(p - s);
+        return s;
+    }
+
+    // A variable's value is itself an expression (usually just a number).
+    int64_t value(const char* nm, size_t len) {
+        name_buf.assign(nm, len);
+        const char* v = var_get(name_buf);
+        if (!v) return 0;
+        if (depth >= 10) return fail("expression recursion level exceeded");
+        Arith sub{v, v + strlen(v), depth + 1};
+        sub.nest = nest;
+        int64_t r = sub.top();
+        if (sub.err) return fail(sub.err);
+        return r;
+    }
+
+    void store(const char* nm, size_t len, int64_t v) {
+        if (skip) return;
+        char buf[24];
+        char* e = buf + sizeof(buf);
+        char* s = e;
+        uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+        do { *--s = (char)('0' + u % 10); u /= 10; } while (u);
+        if (v < 0) *--s = '-';
+        name_buf.assign(nm, len);
+        value_buf.assign(s, (size_t)(e - s));
+        var_set(name_buf, value_buf);
+    }
+
+    // 0x1f hex, 017 octal, otherwise decimal
+    int64_t number() {
+        int base = 10;
+        if (*p == '0' && p + 1 < end && (p[1] == 'x' || p[1] == 'X')) { base = 16; p += 2; }
+        else if (*p == '0') base = 8;
+        const char* s = p;
+        uint64_t v = 0;
+        for (; p < end; ++p) {
+            char c = *p, l = (char)(c | 0x20);
+            int d = is_digit(c) ? c - '0' : (l >= 'a' && l <= 'f') ? l - 'a' + 10 : -1;
+            if (d < 0 || d >= base) break;
+            v = v * (uint64_t)base + (uint64_t)d;
+        }
+        if ((base == 16 && p == s) || (p < end && name_char(*p))) return fail("value too great for base");
+        return (int64_t)v;
+    }
+
+    int64_t primary() {
+        ws();
+        if (p >= end) return fail("syntax error: operand expected");
+        if (*p == '(') {
+            ++p;
+            if (!deeper()) return 0;
+            int64_t v = comma();
+            --nest;
+            if (!at(')')) return fail("syntax error: `)' expected");
+            ++p;
+            return v;
+        }
+        if (is_digit(*p)) return number();
+        if (name_start(*p)) {
+            size_t len;
+            const char* nm = name(len);
+            ws();
+            if (p + 1 < end && (p[0] == '+' || p[0] == '-') && p[1] == p[0]) { // x++ x--
+                int64_t old = value(nm, len);
+                store(nm, len, (int64_t)((uint64_t)old + (p[0] == '+' ? 1 : (uint64_t)-1)));
+                p += 2;
+                return old;
+            }
+            return value(nm, len);
+        }
+        return fail("syntax error: operand expected");
+    }
+
+    int64_t unary() {
+        ws();
+        if (p + 1 < end && (p[0] == '+' || p[0] == '-') && p[1] == p[0]) { // ++x --x
+            const char* q = p + 2;
+            while (q < end && is_space(*q)) ++q;
+            if (q < end && name_start(*q)) {
+                bool inc = p[0] == '+';
+                p = q;
+                size_t len;
+                const char* nm = name(len);
+                int64_t v = (int64_t)((uint64_t)value(nm, len) + (inc ? 1 : (uint64_t)-1));
+                store(nm, len, v);
+                return v;
+            }
+        }
+        if (p < end && (*p == '+' || *p == '-' || *p == '!' || *p == '~')) {
+            char op = *p++;
+            if (!deeper()) return 0;
+            int64_t v = unary();
+            --nest;
+            switch (op) {
+                case '+': return v;
+                case '-': return (int64_t)(0 - (uint64_t)v);
+                case '!': return !v;
+                default:  return ~v;
+            }
+        }
+        return primary();
+    }
+
+    // The binary operator at p, or OP_NONE (compound assignments included).
+    int peek_op(int& len) {
+        ws();
+        len = 1;
+        if (p >= end) return OP_NONE;
+        char c = p[0], d = p + 1 < end ? p[1] : 0, e = p + 2 < end ? p[2] : 0;
+        switch (c) {
+            case '|': if (d == '|') { len = 2; return OP_OROR; } return d == '=' ? OP_NONE : OP_OR;
+            case '&': if (d == '&') { len = 2; return OP_ANDAND; } return d == '=' ? OP_NONE : OP_AND;
+            case '^': return d == '=' ? OP_NONE : OP_XOR;
+            case '=': len = 2; return d == '=' ? OP_EQ : OP_NONE;
+            case '!': len = 2; return d == '=' ? OP_NE : OP_NONE;
+            case '<':
+                if (d == '<') { len = 2; return e == '=' ? OP_NONE : OP_SHL; }
+                if (d == '=') { len = 2; return OP_LE; }
+                return OP_LT;
+            case '>':
+                if (d == '>') { len = 2; return e == '=' ? OP_NONE : OP_SHR; }
+                if (d == '=') { len = 2; return OP_GE; }
+                return OP_GT;
+            case '+': return d == '=' ? OP_NONE : OP_ADD;
+            case '-': return d == '=' ? OP_NONE : OP_SUB;
+            case '*':
+                if (d == '*') { len = 2; return e == '=' ? OP_NONE : OP_POW; }
+                return d == '=' ? OP_NONE : OP_MUL;
+            case '/': return d == '=' ? OP_NONE : OP_DIV;
+            case '%': return d == '=' ? OP_NONE : OP_MOD;
+        }
+        return OP_NONE;
+    }
+
+    int64_t apply(int op, int64_t a, int64_t b) {
+        uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+        switch (op) {
+            case OP_OR:  return a | b;
+            case OP_XOR: return a ^ b;
+            case OP_AND: return a & b;
+            case OP_EQ:  return a == b;
+            case OP_NE:  return a != b;
+            case OP_LT:  return a < b;
+            case OP_LE:  return a <= b;
+            case OP_GT:  return a > b;
+            case OP_GE:  return a >= b;
+            case OP_SHL: return (int64_t)(ua << (b & 63));
+            case OP_SHR: return a >> (b & 63);
+            case OP_ADD: return (int64_t)(ua + ub);
+            case OP_SUB: return (int64_t)(ua - ub);
+            case OP_MUL: return (int64_t)(ua * ub);
+            case OP_DIV:
+            case OP_MOD:
+                if (b == 0) return skip ? 0 : fail("division by 0");
+                if (b == -1) return op == OP_DIV ? (int64_t)(0 - ua) : 0; // INT64_MIN / -1
+                return op == OP_DIV ? a / b : a % b;
+            case OP_POW: {
+                if (b < 0) return skip ? 0 : fail("exponent less than 0");
+                uint64_t r = 1;
+                for (; ub; ub >>= 1, ua *= ua) if (ub & 1) r *= ua;
+                return (int64_t)r;
+            }
+        }
+        return 0;
+    }
+
+    int64_t binary(int min_prec) {
+        int64_t lhs = unary();
+        while (!err) {
+            int len;
+            int op = peek_op(len);
+            if (op == OP_NONE || op_prec[op] < min_prec) break;
+            p += len;
+            if (op == OP_OROR || op == OP_ANDAND) {
+                bool decided = op == OP_OROR ? lhs != 0 : lhs == 0;
+                skip += decided;
+                if (!deeper()) return 0;
+                int64_t rhs = binary(op_prec[op] + 1);
+                --nest;
+                skip -= decided;
+                lhs = op == OP_OROR ? (lhs || rhs) : (lhs && rhs);
+                continue;
+            }
+            if (!deeper()) return 0;
+            int64_t rhs = binary(op == OP_POW ? op_prec[op] : op_prec[op] + 1); // ** is right-associative
+            --nest;
+            lhs = apply(op, lhs, rhs);
+        }
+        return lhs;
+    }
+
+    int64_t ternary() {
+        int64_t c = binary(1);
+        if (err || !at('?')) return c;
+        ++p;
+        skip += !c;
+        if (!deeper()) return 0;
+        int64_t a = assign();
+        --nest;
+        skip -= !c;
+        if (!at(':')) return fail("syntax error: `:' expected for conditional expression");
+        ++p;
+        skip += !!c;
+        if (!deeper()) return 0;
+        int64_t b = ternary();
+        --nest;
+        skip -= !!c;
+        return c ? a : b;
+    }
+
+    // name op= expr, right-associative; anything else is a ternary.
+    int64_t assign() {
+        ws();
+        const char* save = p;
+        if (p < end && name_start(*p)) {
+            size_t len;
+            const char* nm = name(len);
+            ws();
+            int op = OP_NONE, oplen = 0;
+            if (p < end && *p == '=' && !(p + 1 < end && p[1] == '=')) { op = -1; oplen = 1; }
+            else if (peek_op(oplen) == OP_NONE) {
+                static const struct { const char* s; int op; } ops[] = {
+                    {"<<=", OP_SHL}, {">>=", OP_SHR}, {"**=", OP_POW}, {"+=", OP_ADD}, {"-=", OP_SUB},
+                    {"*=", OP_MUL}, {"/=", OP_DIV}, {"%=", OP_MOD}, {"&=", OP_AND}, {"|=", OP_OR}, {"^=", OP_XOR}};
+                for (auto& o : ops) {
+                    size_t n = strlen(o.s);
+                    if ((size_t)(end - p) >= n && memcmp(p, o.s, n) == 0) { op = o.op; oplen = (int)n; break; }
+                }
+            }
+            if (op != OP_NONE) {
+                p += oplen;
+                if (!deeper()) return 0;
+                int64_t rhs = assign();
+                --nest;
+                if (err) return 0;
+                int64_t v = op == -1 ? rhs : apply(op, value(nm, len), rhs);
+                if (err) return 0;
+                store(nm, len, v);
+                return v;
+            }
+            p = save;
+        }
+        return ternary();
+    }
+
+    int64_t comma() {
+        int64_t v = assign();
+        while (!err && at(',')) { ++p; v = assign(); }
+        return v;
+    }
+
+    int64_t top() {
+        ws();
+        if (p == end) return 0;
+        int64_t v = comma();
+        ws();
+        if (!err && p != end) fail("syntax error: invalid arithmetic operator");
+        return v;
+    }
+};
+
+bool arith_eval(const char* expr, size_t len, int64_t& result, const char** err) {
+    Arith a{expr, expr + len, 0};
+    result = a.top();
+    if (a.err) { *err = a.err; return false; }
+    return true;
+}
+
+// let expr...: status 0 when the last value is non-zero
+int builtin_let(char** args) {
+    if (!args[1]) { cerr << "let: expression expected\n"; return 2; }
+    int64_t v = 0;
+    for (int i = 1; args[i]; i++) {
+        const char* err;
+        if (!arith_eval(args[i], strlen(args[i]), v, &err)) {
+            cerr << "let: " << args[i] << ": " << err << "\n";
+            return 2;
+        }
+    }
+    return v != 0 ? 0 : 1;
+}
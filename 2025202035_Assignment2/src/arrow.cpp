@@ -1,12 +1,20 @@
 #include "arrow.h"
 #include "prompt.h"
 #include "common.h"
+#include "builtins.h"
+#include "dircache.h"
+#include "fuzzy.h"
+#include "vars.h"
+#include "warmup.h"
+#include "reactor.h"
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <cstdio>
 #include <cstdlib>
 #include <cctype>
+#include <cstring>
+#include <map>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -50,55 +58,61 @@ void save_history() {
 }
 
 // ---------- Autocomplete logic ----------
-static void add_path_matches(const string& prefix, vector<string>& out) {
-    const char* p = getenv("PATH");
-    if (!p) return;
-    string path(p);
-    size_t start = 0;
-    while (start < path.size()) {
-        size_t pos = path.find(':', start);
-        string dir = (pos == string::npos) ? path.substr(start)
-                                           : path.substr(start, pos - start);
-        start = (pos == string::npos) ? path.size() : pos + 1;
-        DIR* d = opendir(dir.c_str());
-        if (!d) continue;
-        struct dirent* e;
-        while ((e = readdir(d))) {
-            string name = e->d_name;
-            if (name.rfind(prefix, 0) == 0) {
-                string full = dir + "/" + name;
+// Executables of one PATH directory, filtered again only when the
+// directory cache hands out a new listing for it.
+struct PathDir {
+    DirListing listing;
+    vector<string> execs;
+};
+static map<string, PathDir> path_dirs;
+
+static const vector<string>& dir_execs(const string& dir) {
+    PathDir& pd = path_dirs[dir];
+    DirListing ents = dir_entries(dir);
+    if (ents != pd.listing) {
+        pd.listing = ents;
+        pd.execs.clear();
+        if (const vector<string>* warm = warm_execs(ents)) {
+            pd.execs = *warm; // already filtered by the startup warm-up
+        } else if (ents) {
+            for (auto& e : *ents) {
+                string full = dir + "/" + e.name;
                 struct stat st;
-                if (stat(full.c_str(), &st) == 0 && (st.st_mode & S_IXUSR)) {
-                    out.push_back(name);
-                }
+                if (stat(full.c_str(), &st) == 0 && !S_ISDIR(st.st_mode) && (st.st_mode & S_IXUSR))
+                    pd.execs.push_back(e.name);
             }
         }
-        closedir(d);
     }
+    return pd.execs;
+}
+
+static vector<string> path_list() {
+    vector<string> dirs;
+    const char* p = var_get("PATH");
+    if (p) for (auto& d : split_simple(p, ':')) if (!d.empty()) dirs.push_back(d);
+    return dirs;
+}
+
+static void add_path_matches(const string& prefix, vector<string>& out) {
+    for (auto& dir : path_list())
+        for (auto& name : dir_execs(dir))
+            if (name.rfind(prefix, 0) == 0)
+                out.push_back(name);
 }
 
 static vector<string> get_matches(const string& token) {
     vector<string> matches;
 
     // Builtins
-    vector<string> builtins = {
-        "cd", "pwd", "echo", "ls", "pinfo",
-        "search", "history", "exit", "exitall"
-    };
-    for (auto& b : builtins)
+    for (auto& b : builtin_names())
         if (b.rfind(token, 0) == 0)
             matches.push_back(b);
 
     // Current directory entries
-    DIR* d = opendir(".");
-    if (d) {
-        struct dirent* e;
-        while ((e = readdir(d))) {
-            string n = e->d_name;
-            if (n.rfind(token, 0) == 0)
-                matches.push_back(n);
-        }
-        closedir(d);
+    if (DirListing ents = dir_entries(".")) {
+        for (auto& e : *ents)
+            if (e.name.rfind(token, 0) == 0)
+                matches.push_back(e.name);
     }
 
     // PATH matches
@@ -128,12 +142,157 @@ static char* my_generator(const char* text, int state) {
         return nullptr;
 }
 
+// ---------- Fuzzy completion (MYSH_COMPLETION=fuzzy) ----------
+static const size_t FUZZY_LIMIT = 200;
+
+// Every candidate in one index, rebuilt only when a listing behind it changes.
+// The listings in the key are held, so their addresses cannot be reused.
+static FuzzyIndex fuzzy_index;
+static vector<const void*> fuzzy_key;
+static DirListing fuzzy_cwd;
+
+static const FuzzyIndex& fuzzy_candidates() {
+    vector<const void*> key;
+    DirListing cwd = dir_entries(".");
+    key.push_back(cwd.get());
+    vector<string> dirs = path_list();
+    for (auto& d : dirs) {
+        dir_execs(d);
+        key.push_back(path_dirs[d].listing.get());
+    }
+    if (key == fuzzy_key) return fuzzy_index;
+
+    vector<string> all = builtin_names();
+    if (cwd) for (auto& e : *cwd) all.push_back(e.name);
+    for (auto& d : dirs) {
+        const vector<string>& ex = path_dirs[d].execs;
+        all.insert(all.end(), ex.begin(), ex.end());
+    }
+    sort(all.begin(), all.end());
+    all.erase(unique(all.begin(), all.end()), all.end());
+    fuzzy_index.assign(move(all));
+    fuzzy_key = key;
+    fuzzy_cwd = cwd;
+    return fuzzy_index;
+}
+
+static char* fuzzy_generator(const char* text, int state) {
+    static vector<string> ranked;
+    static size_t index;
+
+    if (state == 0) {
+        ranked = fuzzy_candidates().rank(text, FUZZY_LIMIT);
+        index = 0;
+    }
+    if (index < ranked.size())
+        return strdup(ranked[index++].c_str());
+    return nullptr;
+}
+
+static bool fuzzy_mode() {
+    const char* m = var_get("MYSH_COMPLETION");
+    return m && strcmp(m, "fuzzy") == 0;
+}
+
+// Called by readline while it waits for keys. Adopts the startup warm-up
+// and, once that is in, computes completions for the word being typed so
+// the directory listings behind the first Tab are already cached.
+static string spec_token = "\x01";
+
+static int idle_hook() {
+    if (!warmup_poll()) return 0;
+    int s = rl_point;
+    while (s > 0 && !isspace((unsigned char)rl_line_buffer[s - 1])) --s;
+    string token(rl_line_buffer + s, rl_point - s);
+    if (token == spec_token) return 0;
+    spec_token = token;
+    if (fuzzy_mode()) fuzzy_candidates();
+    else get_matches(token);
+    return 0;
+}
+
 static char** my_completion(const char* text, int start, int end) {
     (void)start; (void)end;
+    if (fuzzy_mode()) {
+        rl_sort_completion_matches = 0; // keep rank order in the listing
+        char** m = rl_completion_matches(text, fuzzy_generator);
+        // Matches need not share a prefix: leave the typed word alone
+        if (m && m[1]) {
+            free(m[0]);
+            m[0] = strdup(text);
+        }
+        return m;
+    }
+    rl_sort_completion_matches = 1;
     return rl_completion_matches(text, my_generator);
 }
 
 // ---------- Input function ----------
+// With the reactor running, readline is driven through its callback
+// interface: stdin is one more fd in the event loop, so signals and job
+// events are handled while the user types.
+static string cb_line;
+static bool cb_done = false, cb_eof = false, in_callback = false;
+
+static void on_line(char* l) {
+    if (!l) cb_eof = true;
+    else { cb_line = l; free(l); }
+    cb_done = true;
+    rl_callback_handler_remove();
+}
+
+static char* mysh_readline(const char* prompt) {
+    if (!reactor_active()) return readline(prompt);
+    cb_done = cb_eof = false;
+    in_callback = true;
+    rl_callback_handler_install(prompt, on_line);
+    reactor_add_fd(STDIN_FILENO, [] { rl_callback_read_char(); });
+    while (!cb_done) {
+        reactor_run_once(warmup_poll() ? -1 : 100);
+        if (!cb_done) idle_hook(); // no rl_event_hook in callback mode
+    }
+    reactor_remove_fd(STDIN_FILENO);
+    in_callback = false;
+    return cb_eof ? nullptr : strdup(cb_line.c_str());
+}
+
+static bool in_continuation = false;
+
+// Ctrl+C at the prompt: drop the typed line and start a fresh one. At a
+// continuation prompt the whole unfinished command is dropped.
+void input_interrupted() {
+    if (!in_callback) { cout << "\n"; return; } // a builtin loop was stopped
+    if (in_continuation) {
+        rl_replace_line("", 0);
+        rl_crlf();
+        cb_done = cb_eof = true;
+        rl_callback_handler_remove();
+        return;
+    }
+    rl_replace_line("", 0);
+    rl_crlf();
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+// Print above the prompt and redraw it with the partly typed line intact.
+void input_print_above(const string& text) {
+    if (!in_callback) {
+        cout << text;
+        cout.flush();
+        return;
+    }
+    rl_clear_visible_line();
+    cout << text;
+    cout.flush();
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+void input_resized() {
+    if (in_callback) rl_resize_terminal();
+}
+
 string read_input_line() {
     // Ensure readline does not override our Ctrl+C / Ctrl+Z handlers
     rl_catch_signals = 0;
@@ -141,10 +300,15 @@ string read_input_line() {
 
     // Hook our completion function
     rl_attempted_completion_function = my_completion;
+    rl_event_hook = isatty(STDIN_FILENO) ? idle_hook : nullptr; // with a hook, readline spins at EOF of a pipe
+
+    // Pastes arrive as one block: inserted with a single redisplay, no
+    // completion or key binding run per character
+    rl_variable_bind("enable-bracketed-paste", "on");
 
     // Show colored prompt
     string prompt = get_prompt(true);
-    char* input = readline(prompt.c_str());
+    char* input = mysh_readline(prompt.c_str());
 
     if (!input)
         return string("__MYSH_EOF__"); // Ctrl+D pressed (EOF)
@@ -152,12 +316,26 @@ string read_input_line() {
     string buf(input);
     free(input);
 
-    if (!buf.empty()) {
-        history_store.push_back(buf);
+    // A pasted block is recorded line by line, as if typed
+    for (auto& l : split_simple(buf, '\n')) {
+        if (l.empty()) continue;
+        history_store.push_back(l);
         if ((int)history_store.size() > 20)
             history_store.erase(history_store.begin());
-        add_history(buf.c_str());
+        add_history(l.c_str());
     }
 
     return buf;
-}
\ No newline at end of file
+}
+
+// Continuation lines (open if/while/for, here-doc bodies), not recorded in
+// history. False at EOF or when Ctrl+C abandons the command.
+bool read_continuation_line(string& line) {
+    in_continuation = true;
+    char* in = mysh_readline("> ");
+    in_continuation = false;
+    if (!in) return false;
+    line = in;
+    free(in);
+    return true;
+}
@@ -0,0 +1,129 @@
+#include "bgsched.h"
+#include "vars.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+using namespace std;
+
+#ifdef __linux__
+// From <linux/ioprio.h>, which older kernel headers don't have.
+enum { IO_CLASS_NONE = 0, IO_CLASS_BE = 2, IO_CLASS_IDLE = 3 };
+static const int IO_CLASS_SHIFT = 13, IO_WHO_PROCESS = 1;
+
+bool bgsched_policy(BgPolicy& pol) {
+    static string reported; // a bad $BG_SCHED is reported once per value
+    const char* v = var_get("BG_SCHED");
+    string spec = v ? v : "nice=10";
+    pol = BgPolicy();
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t e = spec.find_first_of(" ,", pos);
+        if (e == string::npos) e = spec.size();
+        string w = spec.substr(pos, e - pos);
+        pos = e + 1;
+        if (w.empty()) continue;
+        if (w == "off") return false;
+        int n;
+        char extra;
+        if (sscanf(w.c_str(), "nice=%d%c", &n, &extra) == 1 && n >= 0 && n <= 19) pol.nice = n;
+        else if (w == "io=idle") pol.ioprio = IO_CLASS_IDLE << IO_CLASS_SHIFT;
+        else if (sscanf(w.c_str(), "io=be:%d%c", &n, &extra) == 1 && n >= 0 && n <= 7) pol.ioprio = (IO_CLASS_BE << IO_CLASS_SHIFT) | n;
+        else if (w == "cpu=idle") pol.policy = SCHED_IDLE;
+        else if (w == "cpu=batch") pol.policy = SCHED_BATCH;
+        else if (reported != spec) cerr << "mysh: BG_SCHED: " << w << ": ignored\n";
+    }
+    reported = spec;
+    return pol.nice >= 0 || pol.ioprio >= 0 || pol.policy >= 0;
+}
+
+// Best effort: lowering priority is always allowed. A nice value is only
+// ever raised, so an explicit renice of the job is kept.
+void bgsched_apply(const BgPolicy& pol, pid_t pid) {
+    if (pol.policy >= 0) {
+        struct sched_param sp;
+        memset(&sp, 0, sizeof(sp));
+        sched_setscheduler(pid, pol.policy, &sp);
+    }
+    if (pol.nice >= 0) {
+        errno = 0;
+        int cur = getpriority(PRIO_PROCESS, (id_t)pid);
+        if (errno == 0 && cur < pol.nice) setpriority(PRIO_PROCESS, (id_t)pid, pol.nice);
+    }
+    if (pol.ioprio >= 0) syscall(SYS_ioprio_set, IO_WHO_PROCESS, pid, pol.ioprio);
+}
+
+// Every thread of every process in the group: nice values and scheduling
+// policies are per thread on Linux.
+template <class F> static void for_each_task(pid_t pgid, F fn) {
+    DIR* d = opendir("/proc");
+    if (!d) return;
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] < '1' || e->d_name[0] > '9') continue;
+        char path[sizeof("/proc//task") + sizeof(e->d_name)], buf[512];
+        snprintf(path, sizeof(path), "/proc/%s/stat", e->d_name);
+        FILE* f = fopen(path, "r");
+        if (!f) continue;
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[n] = '\0';
+        const char* rp = strrchr(buf, ')');
+        char state;
+        int ppid, pgrp;
+        if (!rp || sscanf(rp + 1, " %c %d %d", &state, &ppid, &pgrp) != 3 || pgrp != pgid) continue;
+        snprintf(path, sizeof(path), "/proc/%s/task", e->d_name);
+        DIR* td = opendir(path);
+        if (!td) { fn((pid_t)atoi(e->d_name)); continue; }
+        struct dirent* t;
+        while ((t = readdir(td))) if (t->d_name[0] >= '1' && t->d_name[0] <= '9') fn((pid_t)atoi(t->d_name));
+        closedir(td);
+    }
+    closedir(d);
+}
+
+bool bgsched_demote(pid_t pgid) {
+    BgPolicy pol;
+    if (!bgsched_policy(pol)) return false;
+    for_each_task(pgid, [&](pid_t tid) { bgsched_apply(pol, tid); });
+    return true;
+}
+
+// Back to the shell's own nice value and SCHED_OTHER; the I/O class
+// follows the nice value again. Lowering a nice value needs CAP_SYS_NICE
+// or a high enough RLIMIT_NICE.
+bool bgsched_promote(pid_t pgid) {
+    errno = 0;
+    int base = getpriority(PRIO_PROCESS, 0);
+    if (errno) base = 0;
+    bool ok = true;
+    for_each_task(pgid, [&](pid_t tid) {
+        int cur = sched_getscheduler(tid);
+        if (cur == SCHED_IDLE || cur == SCHED_BATCH) {
+            struct sched_param sp;
+            memset(&sp, 0, sizeof(sp));
+            if (sched_setscheduler(tid, SCHED_OTHER, &sp) < 0 && errno != ESRCH) ok = false;
+        }
+        errno = 0;
+        int nv = getpriority(PRIO_PROCESS, (id_t)tid);
+        if (errno == 0 && nv > base && setpriority(PRIO_PROCESS, (id_t)tid, base) < 0 && errno != ESRCH) ok = false;
+        syscall(SYS_ioprio_set, IO_WHO_PROCESS, tid, IO_CLASS_NONE << IO_CLASS_SHIFT);
+    });
+    return ok;
+}
+
+#else
+bool bgsched_policy(BgPolicy&) { return false; }
+void bgsched_apply(const BgPolicy&, pid_t) {}
+bool bgsched_demote(pid_t) { return false; }
+bool bgsched_promote(pid_t) { return true; }
+#endif
@@ -2,6 +2,13 @@
 #include "builtins.h"
 #include "common.h"
 #include "history.h"
+#include "vars.h"
+#include "mysh_builtin.h"
+#include "dircache.h"
+#include "reactor.h"
+#include "jobs.h"
+#include "affinity.h"
+#include "arith.h"
 #include <sys/stat.h>
 #include <dirent.h>
 #include <pwd.h>
@@ -18,15 +25,17 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <cstring>
+#include <cerrno>
 #include <limits.h>
 #include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <array>
+#include <map>
+#include <string_view>
+#include <dlfcn.h>
 using namespace std;
 
-static vector<string> builtin_list = {"cd","pwd","echo","ls","pinfo","search","history","exit","exitall"};
-bool is_builtin(const string& cmd){
-    return find(builtin_list.begin(), builtin_list.end(), cmd) != builtin_list.end();
-}
-
 static string home_dir;   // set when shell starts
 static string oldpwd;     // OLDPWD
 
@@ -263,22 +272,25 @@ static void print_long_format(const string& path, const string& name) {
 }
 
 static void ls_directory(const string& path, bool flag_a, bool flag_l) {
-    DIR* dir = opendir(path.c_str());
-    if (!dir) {
+    DirListing listing = dir_entries(path);
+    if (!listing) {
         perror("opendir");
         return;
     }
 
     vector<string> entries;
-    struct dirent* entry;
     long total_blocks = 0;
+    if (flag_a) {
+        entries.push_back(".");
+        entries.push_back("..");
+    }
+    for (auto& e : *listing) {
+        if (!flag_a && e.name[0] == '.') continue; // skip hidden unless -a
+        entries.push_back(e.name);
+    }
 
-    while ((entry = readdir(dir)) != NULL) {
-        string name = entry->d_name;
-        if (!flag_a && name[0] == '.') continue; // skip hidden unless -a
-        entries.push_back(name);
-
-        if (flag_l) {
+    if (flag_l) {
+        for (auto& name : entries) {
             struct stat st;
             string fullpath = path + "/" + name;
             if (stat(fullpath.c_str(), &st) == 0) {
@@ -286,7 +298,6 @@ static void ls_directory(const string& path, bool flag_a, bool flag_l) {
             }
         }
     }
-    closedir(dir);
 
     sort(entries.begin(), entries.end());
 
@@ -306,12 +317,8 @@ static void ls_directory(const string& path, bool flag_a, bool flag_l) {
         max_len = max(max_len, n.size());
     }
 
-    // Detect terminal width
-    struct winsize w;
-    int term_width = 80; // fallback
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0) {
-        term_width = w.ws_col;
-    }
+    // Terminal width, cached by the reactor from SIGWINCH
+    int term_width = term_cols();
 
     size_t col_width = max_len + 2;
     size_t cols = term_width / col_width;
@@ -371,17 +378,293 @@ int builtin_ls(char** args) {
 }
 
 
+// ---------- test / [ ----------
+// Recursive descent over the arguments:
+//   or := and (-o and)*   and := not (-a not)*   not := ! not | primary
+//   primary := ( or ) | unary-op arg | arg binary-op arg | arg
+// Status 0 true, 1 false, 2 on a malformed expression.
+struct TestExpr {
+    char** a;
+    int n, i = 0;
+    string err;
+
+    bool more() const { return i < n; }
+    bool at(const char* s) const { return i < n && strcmp(a[i], s) == 0; }
+
+    static bool is_binary(const char* op) {
+        static const char* const ops[] = {"=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot"};
+        for (const char* o : ops) if (strcmp(op, o) == 0) return true;
+        return false;
+    }
+    static bool is_unary(const char* op) {
+        return op[0] == '-' && op[1] && !op[2] && strchr("nzefdrwxsLhp", op[1]);
+    }
+
+    bool integer(const char* s, long long& v) {
+        char* end;
+        errno = 0;
+        v = strtoll(s, &end, 10);
+        if (*s && !*end && errno == 0) return true;
+        if (err.empty()) err = string(s) + ": integer expression expected";
+        return false;
+    }
+
+    bool binary(const char* l, const char* op, const char* r) {
+        if (!strcmp(op, "=") || !strcmp(op, "==")) return strcmp(l, r) == 0;
+        if (!strcmp(op, "!=")) return strcmp(l, r) != 0;
+        if (op[1] == 'n' && op[2] == 't') return mtime_cmp(l, r) > 0;
+        if (op[1] == 'o' && op[2] == 't') return mtime_cmp(l, r) < 0;
+        long long x, y;
+        if (!integer(l, x) || !integer(r, y)) return false;
+        switch (op[1] * 256 + op[2]) {
+            case 'e' * 256 + 'q': return x == y;
+            case 'n' * 256 + 'e': return x != y;
+            case 'l' * 256 + 't': return x < y;
+            case 'l' * 256 + 'e': return x <= y;
+            case 'g' * 256 + 't': return x > y;
+            default:              return x >= y;
+        }
+    }
+
+    static int mtime_cmp(const char* l, const char* r) {
+        struct stat a, b;
+        bool ha = stat(l, &a) == 0, hb = stat(r, &b) == 0;
+        if (!ha || !hb) return ha - hb;
+        return (a.st_mtime > b.st_mtime) - (a.st_mtime < b.st_mtime);
+    }
+
+    static bool unary(char op, const char* s) {
+        struct stat st;
+        switch (op) {
+            case 'n': return *s != '\0';
+            case 'z': return *s == '\0';
+            case 'e': return stat(s, &st) == 0;
+            case 'f': return stat(s, &st) == 0 && S_ISREG(st.st_mode);
+            case 'd': return stat(s, &st) == 0 && S_ISDIR(st.st_mode);
+            case 'p': return stat(s, &st) == 0 && S_ISFIFO(st.st_mode);
+            case 's': return stat(s, &st) == 0 && st.st_size > 0;
+            case 'L': case 'h': return lstat(s, &st) == 0 && S_ISLNK(st.st_mode);
+            case 'r': return access(s, R_OK) == 0;
+            case 'w': return access(s, W_OK) == 0;
+            default:  return access(s, X_OK) == 0;
+        }
+    }
+
+    bool primary() {
+        if (!more()) { err = "argument expected"; return false; }
+        if (at("(") && i + 1 < n) {
+            ++i;
+            bool v = or_expr();
+            if (!at(")")) { if (err.empty()) err = "')' expected"; return false; }
+            ++i;
+            return v;
+        }
+        if (i + 2 < n && is_binary(a[i + 1])) {
+            bool v = binary(a[i], a[i + 1], a[i + 2]);
+            i += 3;
+            return v;
+        }
+        if (is_unary(a[i]) && i + 1 < n) {
+            bool v = unary(a[i][1], a[i + 1]);
+            i += 2;
+            return v;
+        }
+        return a[i++][0] != '\0';
+    }
+    bool not_expr() {
+        if (at("!") && i + 1 < n) { ++i; return !not_expr(); }
+        return primary();
+    }
+    bool and_expr() {
+        bool v = not_expr();
+        while (at("-a")) { ++i; v = not_expr() && v; }
+        return v;
+    }
+    bool or_expr() {
+        bool v = and_expr();
+        while (at("-o")) { ++i; v = and_expr() || v; }
+        return v;
+    }
+};
+
+int builtin_test(char** args) {
+    int n = 0;
+    while (args[n]) n++;
+    const char* name = args[0];
+    if (strcmp(name, "[") == 0) {
+        if (n < 2 || strcmp(args[n - 1], "]") != 0) { cerr << "[: missing `]'\n"; return 2; }
+        --n;
+    }
+    if (n <= 1) return 1; // no expression is false
+    TestExpr t{args + 1, n - 1, 0, {}};
+    bool v = t.or_expr();
+    if (t.err.empty() && t.more()) t.err = string(args[t.i + 1]) + ": unexpected argument";
+    if (!t.err.empty()) { cerr << name << ": " << t.err << "\n"; return 2; }
+    return v ? 0 : 1;
+}
+
+int builtin_true(char**) { return 0; }
+int builtin_false(char**) { return 1; }
+
+
+// ---------- Builtin registry ----------
+// Static builtins are found through a perfect hash computed at compile
+// time: one hash and one string compare per lookup.
+struct StaticBuiltin {
+    string_view name;
+    int (*fn)(char**);
+    int flags;
+};
+
+static constexpr int BI_BOTH = MYSH_BI_PARENT | MYSH_BI_PIPELINE;
+static constexpr StaticBuiltin static_builtins[] = {
+    {"cd", builtin_cd, MYSH_BI_PARENT},
+    {"pwd", builtin_pwd, BI_BOTH},
+    {"echo", builtin_echo, BI_BOTH},
+    {"ls", builtin_ls, BI_BOTH},
+    {"pinfo", builtin_pinfo, BI_BOTH},
+    {"search", builtin_search, BI_BOTH},
+    {"history", builtin_history, BI_BOTH},
+    {"export", builtin_export, MYSH_BI_PARENT},
+    {"unset", builtin_unset, MYSH_BI_PARENT},
+    {"enable", builtin_enable, MYSH_BI_PARENT},
+    {"jobs", builtin_jobs, BI_BOTH},
+    {"fg", builtin_fg, MYSH_BI_PARENT},
+    {"bg", builtin_bg, MYSH_BI_PARENT},
+    {"limit", builtin_limit, MYSH_BI_PARENT},
+    {"pin", builtin_pin, MYSH_BI_PARENT},
+    {"renice", builtin_renice, MYSH_BI_PARENT},
+    {"test", builtin_test, BI_BOTH},
+    {"[", builtin_test, BI_BOTH},
+    {"true", builtin_true, BI_BOTH},
+    {"false", builtin_false, BI_BOTH},
+    {":", builtin_true, BI_BOTH},
+    {"let", builtin_let, BI_BOTH},
+    {"break", nullptr, MYSH_BI_PARENT},    // handled by the interpreter
+    {"continue", nullptr, MYSH_BI_PARENT},
+    {"exit", nullptr, MYSH_BI_PARENT},     // handled by the main loop and the interpreter
+    {"exitall", nullptr, MYSH_BI_PARENT},
+};
+static constexpr size_t N_STATIC = sizeof(static_builtins) / sizeof(static_builtins[0]);
+static constexpr size_t PH_SIZE = 128; // power of two, well above N_STATIC so a seed is found quickly
+
+static constexpr uint32_t ph_hash(string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) { h ^= (unsigned char)c; h *= 16777619u; }
+    return h & (PH_SIZE - 1);
+}
+
+static constexpr uint32_t ph_find_seed() {
+    for (uint32_t seed = 0;; ++seed) {
+        bool used[PH_SIZE] = {};
+        bool ok = true;
+        for (size_t i = 0; i < N_STATIC && ok; ++i) {
+            uint32_t h = ph_hash(static_builtins[i].name, seed);
+            if (used[h]) ok = false;
+            used[h] = true;
+        }
+        if (ok) return seed;
+    }
+}
+
+static constexpr uint32_t PH_SEED = ph_find_seed();
+
+static constexpr array<int8_t, PH_SIZE> ph_build() {
+    array<int8_t, PH_SIZE> t{};
+    for (auto& v : t) v = -1;
+    for (size_t i = 0; i < N_STATIC; ++i) t[ph_hash(static_builtins[i].name, PH_SEED)] = (int8_t)i;
+    return t;
+}
+
+static constexpr array<int8_t, PH_SIZE> ph_table = ph_build();
+
+static const StaticBuiltin* find_static(string_view name) {
+    int8_t i = ph_table[ph_hash(name, PH_SEED)];
+    if (i < 0 || static_builtins[i].name != name) return nullptr;
+    return &static_builtins[i];
+}
+
+// Builtins loaded with `enable -f`; consulted first so they may override.
+struct LoadedBuiltin {
+    const mysh_builtin* def;
+    void* handle;
+};
+static map<string, LoadedBuiltin> loaded_builtins;
+
+static const LoadedBuiltin* find_loaded(const char* name) {
+    if (loaded_builtins.empty()) return nullptr;
+    auto it = loaded_builtins.find(name);
+    return it == loaded_builtins.end() ? nullptr : &it->second;
+}
+
+bool is_builtin(const string& cmd){
+    return builtin_flags(cmd.c_str()) != 0;
+}
+
+int builtin_flags(const char* cmd) {
+    if (!cmd) return 0;
+    if (auto lb = find_loaded(cmd)) return lb->def->flags;
+    if (auto sb = find_static(cmd)) return sb->flags;
+    return 0;
+}
+
+vector<string> builtin_names() {
+    vector<string> names;
+    for (auto& b : static_builtins) names.emplace_back(b.name);
+    for (auto& kv : loaded_builtins) names.push_back(kv.first);
+    return names;
+}
+
+int builtin_enable(char** args) {
+    if (!args[1]) {
+        for (auto& b : static_builtins) cout << "enable " << b.name << "\n";
+        for (auto& kv : loaded_builtins) cout << "enable " << kv.first << " (loaded)\n";
+        return 0;
+    }
+    string opt = args[1];
+    if (opt == "-d") {
+        int rc = 0;
+        for (int i = 2; args[i]; i++) {
+            auto it = loaded_builtins.find(args[i]);
+            if (it == loaded_builtins.end()) { cerr << "enable: " << args[i] << ": not a dynamically loaded builtin\n"; rc = 1; continue; }
+            void* h = it->second.handle;
+            loaded_builtins.erase(it);
+            bool shared = false;
+            for (auto& kv : loaded_builtins) if (kv.second.handle == h) shared = true;
+            if (!shared) dlclose(h);
+        }
+        return rc;
+    }
+    if (opt != "-f" || !args[2] || !args[3]) {
+        cerr << "enable: usage: enable [-f file.so name ...] [-d name ...]\n";
+        return 1;
+    }
+    void* h = dlopen(args[2], RTLD_NOW | RTLD_LOCAL);
+    if (!h) { cerr << "enable: " << dlerror() << "\n"; return 1; }
+    int rc = 0, added = 0;
+    for (int i = 3; args[i]; i++) {
+        string sym = string("mysh_builtin_") + args[i];
+        auto def = (const mysh_builtin*)dlsym(h, sym.c_str());
+        if (!def) { cerr << "enable: " << args[i] << ": " << sym << " not found in " << args[2] << "\n"; rc = 1; continue; }
+        if (def->abi != MYSH_BUILTIN_ABI || !def->fn) { cerr << "enable: " << args[i] << ": incompatible builtin ABI\n"; rc = 1; continue; }
+        loaded_builtins[args[i]] = {def, h};
+        added++;
+    }
+    if (!added) dlclose(h);
+    return rc;
+}
+
 int builtin_dispatch(char** argv) {
     if (!argv || !argv[0]) return -1;
-    string cmd = argv[0];
-
-    if (cmd == "cd") return builtin_cd(argv);
-    if (cmd == "pwd") return builtin_pwd(argv);
-    if (cmd == "echo") return builtin_echo(argv);
-    if (cmd == "ls") return builtin_ls(argv);
-    if (cmd == "pinfo") return builtin_pinfo(argv);
-    if (cmd == "search") return builtin_search(argv);
-    if (cmd == "history") return builtin_history(argv);
+
+    if (auto lb = find_loaded(argv[0])) {
+        int argc = 0;
+        while (argv[argc]) argc++;
+        int rc = lb->def->fn(argc, argv);
+        fflush(stdout);
+        return rc;
+    }
+    if (auto sb = find_static(argv[0])) return sb->fn ? sb->fn(argv) : -1;
 
     return -1; // not a builtin
 }
\ No newline at end of file
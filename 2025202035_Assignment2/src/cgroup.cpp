@@ -0,0 +1,336 @@
+#include "cgroup.h"
+#include "common.h"
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+using namespace std;
+
+// 123, or "max" (-1) where allowed
+static bool parse_count(const char* s, long long& out, bool allow_max) {
+    if (allow_max && strcmp(s, "max") == 0) { out = -1; return true; }
+    char* end;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (errno || end == s || *end || v <= 0) return false;
+    out = v;
+    return true;
+}
+
+// 512K, 2G, 1048576, or "max"
+static bool parse_size(const char* s, long long& out) {
+    if (strcmp(s, "max") == 0) { out = -1; return true; }
+    char* end;
+    errno = 0;
+    double v = strtod(s, &end);
+    if (errno || end == s || v <= 0) return false;
+    double mult = 1;
+    switch (*end) {
+        case 'k': case 'K': mult = 1024.0; ++end; break;
+        case 'm': case 'M': mult = 1024.0 * 1024; ++end; break;
+        case 'g': case 'G': mult = 1024.0 * 1024 * 1024; ++end; break;
+        case 't': case 'T': mult = 1024.0 * 1024 * 1024 * 1024; ++end; break;
+    }
+    if (*end == 'B' || *end == 'b') ++end;
+    if (*end || v * mult >= 9e18) return false;
+    out = (long long)(v * mult);
+    return out > 0;
+}
+
+int cgroup_parse_limits(char** args, CgLimits& lim, const char* who) {
+    int i = 1;
+    for (; args[i]; i++) {
+        const char* opt = args[i];
+        if (strcmp(opt, "--") == 0) return i + 1;
+        if (strncmp(opt, "--", 2) != 0) break;
+        bool known = strcmp(opt, "--cpu-weight") == 0 || strcmp(opt, "--cpu-max") == 0 ||
+                     strcmp(opt, "--mem-max") == 0 || strcmp(opt, "--pids-max") == 0;
+        if (!known) { cerr << who << ": " << opt << ": unknown option\n"; return -1; }
+        if (!args[i + 1]) { cerr << who << ": " << opt << ": value expected\n"; return -1; }
+        const char* v = args[++i];
+        bool ok;
+        if (strcmp(opt, "--cpu-weight") == 0) {
+            ok = parse_count(v, lim.cpu_weight, false) && lim.cpu_weight <= 10000;
+        } else if (strcmp(opt, "--cpu-max") == 0) { // 50 or 50%: half a CPU; 200%: two
+            string pct = v;
+            if (!pct.empty() && pct.back() == '%') pct.pop_back();
+            ok = parse_count(pct.c_str(), lim.cpu_max, true);
+        } else if (strcmp(opt, "--mem-max") == 0) {
+            ok = parse_size(v, lim.mem_max);
+        } else {
+            ok = parse_count(v, lim.pids_max, true);
+        }
+        if (!ok) { cerr << who << ": " << opt << ": invalid value `" << v << "'\n"; return -1; }
+    }
+    return i;
+}
+
+#ifdef __linux__
+static string base_dir;   // delegated directory the job cgroups go under
+static unsigned job_seq = 0;
+
+static bool read_file(const string& path, string& out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    out.clear();
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) out.append(buf, (size_t)n);
+    close(fd);
+    return n == 0;
+}
+
+// One write(2) per value: cgroup files take a single value per write.
+static int write_file(const string& path, const string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    int err = write(fd, value.data(), value.size()) == (ssize_t)value.size() ? 0 : errno;
+    close(fd);
+    return err;
+}
+
+static bool has_word(const string& list, const string& w) {
+    size_t pos = 0;
+    while ((pos = list.find(w, pos)) != string::npos) {
+        bool left = pos == 0 || isspace((unsigned char)list[pos - 1]);
+        size_t e = pos + w.size();
+        if (left && (e == list.size() || isspace((unsigned char)list[e]))) return true;
+        pos = e;
+    }
+    return false;
+}
+
+// $MYSH_CGROUP, else the shell's own cgroup on the cgroup2 mount.
+static bool find_base(const char* who) {
+    if (!base_dir.empty()) return true;
+    string dir;
+    const char* env = getenv("MYSH_CGROUP");
+    if (env && *env) {
+        dir = env;
+    } else {
+        string info, self, mnt;
+        if (read_file("/proc/self/mountinfo", info)) {
+            size_t pos = 0;
+            while (pos < info.size() && mnt.empty()) {
+                size_t nl = info.find('\n', pos);
+                if (nl == string::npos) nl = info.size();
+                string line = info.substr(pos, nl - pos);
+                pos = nl + 1;
+                size_t sep = line.find(" - ");
+                if (sep == string::npos || line.compare(sep + 3, 8, "cgroup2 ") != 0) continue;
+                size_t f = 0;
+                for (int k = 0; k < 4 && f != string::npos; k++) f = line.find(' ', f + 1); // 5th field
+                if (f != string::npos) mnt = line.substr(f + 1, line.find(' ', f + 1) - f - 1);
+            }
+        }
+        if (read_file("/proc/self/cgroup", self)) {
+            size_t p = self.find("0::");
+            if (p != string::npos) self = self.substr(p + 3, self.find('\n', p) - p - 3);
+            else self.clear();
+        }
+        if (mnt.empty() || self.empty()) {
+            cerr << who << ": no cgroup v2 hierarchy (set MYSH_CGROUP to a delegated directory)\n";
+            return false;
+        }
+        dir = self == "/" ? mnt : mnt + self;
+    }
+    if (access((dir + "/cgroup.subtree_control").c_str(), W_OK) != 0) {
+        cerr << who << ": " << dir << ": not delegated to this user (" << strerror(errno) << ")\n";
+        return false;
+    }
+    base_dir = dir;
+    return true;
+}
+
+// A cgroup with processes can't pass controllers down ("no internal
+// processes"), so the ones in the base move into a leaf first.
+static bool evacuate_base(const char* who) {
+    string leaf = base_dir + "/mysh-shell", procs;
+    if (mkdir(leaf.c_str(), 0755) < 0 && errno != EEXIST) {
+        cerr << who << ": " << leaf << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    if (!read_file(base_dir + "/cgroup.procs", procs)) return false;
+    size_t pos = 0;
+    while (pos < procs.size()) {
+        size_t nl = procs.find('\n', pos);
+        if (nl == string::npos) nl = procs.size();
+        string pid = procs.substr(pos, nl - pos);
+        pos = nl + 1;
+        if (pid.empty()) continue;
+        int err = write_file(leaf + "/cgroup.procs", pid);
+        if (err && err != ESRCH) {
+            cerr << who << ": moving " << pid << " to " << leaf << ": " << strerror(err) << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool enable_controller(const char* ctl, const char* who) {
+    string enabled, avail;
+    read_file(base_dir + "/cgroup.subtree_control", enabled);
+    if (has_word(enabled, ctl)) return true;
+    read_file(base_dir + "/cgroup.controllers", avail);
+    if (!has_word(avail, ctl)) {
+        cerr << who << ": the " << ctl << " controller is not available in " << base_dir << "\n";
+        return false;
+    }
+    string req = string("+") + ctl;
+    int err = write_file(base_dir + "/cgroup.subtree_control", req);
+    if (err == EBUSY && evacuate_base(who)) err = write_file(base_dir + "/cgroup.subtree_control", req);
+    if (err) {
+        cerr << who << ": enabling " << ctl << " in " << base_dir << ": " << strerror(err) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool cgroup_apply(const string& dir, const CgLimits& lim, const char* who) {
+    struct { const char* ctl; const char* file; long long v; string value; } set[] = {
+        {"cpu", "cpu.weight", lim.cpu_weight, to_string(lim.cpu_weight)},
+        {"cpu", "cpu.max", lim.cpu_max, lim.cpu_max < 0 ? "max 100000" : to_string(lim.cpu_max * 1000) + " 100000"},
+        {"memory", "memory.max", lim.mem_max, lim.mem_max < 0 ? "max" : to_string(lim.mem_max)},
+        {"pids", "pids.max", lim.pids_max, lim.pids_max < 0 ? "max" : to_string(lim.pids_max)},
+    };
+    for (auto& s : set) {
+        if (!s.v) continue;
+        if (!enable_controller(s.ctl, who)) return false;
+        int err = write_file(dir + "/" + s.file, s.value);
+        if (err) {
+            cerr << who << ": " << dir << "/" << s.file << ": " << strerror(err) << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+string cgroup_create(const CgLimits& lim, const char* who) {
+    if (!find_base(who)) return "";
+    // Controllers are enabled before the mkdir so the interface files exist.
+    if ((lim.cpu_weight || lim.cpu_max) && !enable_controller("cpu", who)) return "";
+    if (lim.mem_max && !enable_controller("memory", who)) return "";
+    if (lim.pids_max && !enable_controller("pids", who)) return "";
+    string dir = base_dir + "/mysh-" + to_string(getpid()) + "-" + to_string(++job_seq);
+    if (mkdir(dir.c_str(), 0755) < 0) {
+        cerr << who << ": " << dir << ": " << strerror(errno) << "\n";
+        return "";
+    }
+    if (!cgroup_apply(dir, lim, who)) {
+        rmdir(dir.c_str());
+        return "";
+    }
+    return dir;
+}
+
+int cgroup_open(const string& dir) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) perror(dir.c_str());
+    return fd;
+}
+
+// A plain fork() (glibc resets its locks for the child, which matters with
+// relay and warmup threads around); the child moves itself in before it
+// does anything else.
+pid_t cgroup_fork(int cgfd) {
+    pid_t pid = fork();
+    if (cgfd < 0) return pid;
+    if (pid == 0) {
+        int fd = openat(cgfd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write(fd, "0", 1) != 1) { perror("cgroup.procs"); _exit(126); }
+        close(fd);
+    }
+    return pid;
+}
+
+// Every process whose pgrp is pgid; /proc/N/stat has it after "comm)".
+bool cgroup_adopt(const string& dir, pid_t pgid) {
+    DIR* d = opendir("/proc");
+    if (!d) return false;
+    bool moved = false;
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] < '1' || e->d_name[0] > '9') continue;
+        string stat;
+        if (!read_file(string("/proc/") + e->d_name + "/stat", stat)) continue;
+        size_t rp = stat.rfind(')');
+        char state;
+        int ppid, pgrp;
+        if (rp == string::npos || sscanf(stat.c_str() + rp + 1, " %c %d %d", &state, &ppid, &pgrp) != 3) continue;
+        if (pgrp != pgid) continue;
+        int err = write_file(dir + "/cgroup.procs", e->d_name);
+        if (err && err != ESRCH) {
+            cerr << "limit: moving " << e->d_name << ": " << strerror(err) << "\n";
+            continue;
+        }
+        moved = true;
+    }
+    closedir(d);
+    return moved;
+}
+
+void cgroup_release(const string& dir) {
+    if (!dir.empty()) rmdir(dir.c_str());
+}
+
+static long long stat_key(const string& text, const char* key) {
+    size_t k = strlen(key), pos = 0;
+    while (pos < text.size()) {
+        if (text.compare(pos, k, key) == 0 && text[pos + k] == ' ') return atoll(text.c_str() + pos + k + 1);
+        pos = text.find('\n', pos);
+        if (pos == string::npos) break;
+        ++pos;
+    }
+    return -1;
+}
+
+// cpu 1.20s (user 1.00s sys 0.20s, throttled 0.50s)  mem 12.0M/64.0M peak 20.0M  pids 3/32
+string cgroup_stats(const string& dir) {
+    string out, text;
+    char buf[160];
+    if (read_file(dir + "/cpu.stat", text)) {
+        snprintf(buf, sizeof(buf), "cpu %.2fs (user %.2fs sys %.2fs", stat_key(text, "usage_usec") / 1e6,
+                 stat_key(text, "user_usec") / 1e6, stat_key(text, "system_usec") / 1e6);
+        out += buf;
+        long long thr = stat_key(text, "throttled_usec");
+        if (thr > 0) { snprintf(buf, sizeof(buf), ", throttled %.2fs", thr / 1e6); out += buf; }
+        out += ")";
+    }
+    if (read_file(dir + "/memory.current", text)) {
+        out += "  mem " + human_bytes((double)atoll(text.c_str()));
+        if (read_file(dir + "/memory.max", text) && text.compare(0, 3, "max") != 0) out += "/" + human_bytes((double)atoll(text.c_str()));
+        if (read_file(dir + "/memory.peak", text)) out += " peak " + human_bytes((double)atoll(text.c_str()));
+    }
+    if (read_file(dir + "/pids.current", text)) {
+        out += "  pids " + to_string(atoll(text.c_str()));
+        if (read_file(dir + "/pids.max", text) && text.compare(0, 3, "max") != 0) out += "/" + to_string(atoll(text.c_str()));
+    }
+    return out;
+}
+
+#else
+string cgroup_create(const CgLimits&, const char* who) {
+    cerr << who << ": cgroups need Linux\n";
+    return "";
+}
+bool cgroup_apply(const string&, const CgLimits&, const char* who) {
+    cerr << who << ": cgroups need Linux\n";
+    return false;
+}
+int cgroup_open(const string&) { return -1; }
+pid_t cgroup_fork(int) { return fork(); }
+bool cgroup_adopt(const string&, pid_t) { return false; }
+void cgroup_release(const string&) {}
+string cgroup_stats(const string&) { return ""; }
+#endif
@@ -1,6 +1,7 @@
 #include "common.h"
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
 #include <string>
 #include <vector>
 using namespace std;
@@ -38,4 +39,13 @@ vector<string> split_simple(const string& s, char delim) {
         }
     }
     return out;
-}
\ No newline at end of file
+}
+
+string human_bytes(double bytes) {
+    char buf[32];
+    const char* units = "BKMGT";
+    int u = 0;
+    while (bytes >= 1024 && u < 4) { bytes /= 1024; u++; }
+    snprintf(buf, sizeof(buf), u ? "%.1f%c" : "%.0f%c", bytes, units[u]);
+    return buf;
+}
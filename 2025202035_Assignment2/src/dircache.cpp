@@ -0,0 +1,147 @@
+#include "dircache.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <ctime>
+#include <list>
+#include <map>
+#include <utility>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+using namespace std;
+
+static const size_t DIRCACHE_MAX = 64; // directories kept
+
+struct CachedDir {
+    pair<dev_t, ino_t> key;
+    struct timespec mtime, ctime;
+    bool racy;   // changed within the timestamp granularity of the read
+    int wd = -1; // inotify watch
+    DirListing entries;
+};
+
+static list<CachedDir> lru; // most recently used first
+static map<pair<dev_t, ino_t>, list<CachedDir>::iterator> index_of;
+
+#ifdef __linux__
+#define ST_MTIM(st) (st).st_mtim
+#define ST_CTIM(st) (st).st_ctim
+#elif defined(__APPLE__)
+#define ST_MTIM(st) (st).st_mtimespec
+#define ST_CTIM(st) (st).st_ctimespec
+#endif
+
+static bool same_time(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static void drop(list<CachedDir>::iterator it);
+
+#ifdef __linux__
+static int ino_fd = -2; // -2: not opened yet, -1: unavailable
+
+// Drains pending events and drops every listing that was touched.
+static void drain_inotify() {
+    if (ino_fd < 0) return;
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t n;
+    while ((n = read(ino_fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            for (auto it = lru.begin(); it != lru.end(); ++it)
+                if (it->wd == ev->wd) { drop(it); break; }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+static int watch(const string& path) {
+    if (ino_fd == -2) ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ino_fd < 0) return -1;
+    return inotify_add_watch(ino_fd, path.c_str(),
+                             IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                             IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+}
+
+static void unwatch(int wd) {
+    if (wd >= 0 && ino_fd >= 0) inotify_rm_watch(ino_fd, wd);
+}
+#else
+static void drain_inotify() {}
+static int watch(const string&) { return -1; }
+static void unwatch(int) {}
+#endif
+
+static void drop(list<CachedDir>::iterator it) {
+    unwatch(it->wd);
+    index_of.erase(it->key);
+    lru.erase(it);
+}
+
+static void store(const struct stat& st, const struct timespec& before, int wd, DirListing entries) {
+    CachedDir c;
+    c.key = make_pair(st.st_dev, st.st_ino);
+    c.mtime = ST_MTIM(st);
+    c.ctime = ST_CTIM(st);
+    // File system clocks are coarse: a change in the same second as the read
+    // could leave mtime unchanged, so such a listing is not trusted alone.
+    c.racy = ST_CTIM(st).tv_sec >= before.tv_sec - 1;
+    c.wd = wd;
+    c.entries = entries;
+    lru.push_front(c);
+    index_of[c.key] = lru.begin();
+    if (lru.size() > DIRCACHE_MAX) drop(prev(lru.end()));
+}
+
+static DirListing read_dir(const string& path) {
+    DIR* d = opendir(path.c_str());
+    if (!d) return nullptr;
+    auto v = make_shared<vector<DirEntry>>();
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.' && (e->d_name[1] == '\0' || (e->d_name[1] == '.' && e->d_name[2] == '\0'))) continue;
+        v->push_back({e->d_name, e->d_type});
+    }
+    closedir(d);
+    return v;
+}
+
+DirListing dir_entries(const string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return nullptr;
+    if (!S_ISDIR(st.st_mode)) { errno = ENOTDIR; return nullptr; }
+    drain_inotify();
+
+    pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+    auto found = index_of.find(key);
+    if (found != index_of.end()) {
+        CachedDir& c = *found->second;
+        // A racy listing is only trusted while inotify vouches for it
+        if (same_time(c.mtime, ST_MTIM(st)) && same_time(c.ctime, ST_CTIM(st)) && (!c.racy || c.wd >= 0)) {
+            lru.splice(lru.begin(), lru, found->second);
+            return c.entries;
+        }
+        drop(found->second);
+    }
+
+    struct timespec before;
+    clock_gettime(CLOCK_REALTIME, &before);
+    int wd = watch(path); // before the read, so no change can slip in between
+    DirListing entries = read_dir(path);
+    if (!entries) { unwatch(wd); return nullptr; }
+    store(st, before, wd, entries);
+    return entries;
+}
+
+void dir_cache_insert(const string& path, const struct stat& st, const struct timespec& read_at, DirListing entries) {
+    pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+    if (index_of.count(key)) return;
+    // Watched only from now on, so inotify cannot vouch for a racy listing;
+    // older changes are caught by mtime/ctime.
+    if (ST_CTIM(st).tv_sec >= read_at.tv_sec - 1) return;
+    int wd = watch(path);
+    store(st, read_at, wd, entries);
+}
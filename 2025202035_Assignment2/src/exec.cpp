@@ -1,35 +1,110 @@
 #include "exec.h"
 #include "builtins.h"
+#include "mysh_builtin.h"
 #include "signals.h"
 #include "common.h"
+#include "vars.h"
+#include "wildcard.h"
+#include "zygote.h"
+#include "warmup.h"
+#include "reactor.h"
+#include "jobs.h"
+#include "cgroup.h"
+#include "affinity.h"
+#include "bgsched.h"
+#include "pipemeter.h"
+#include "fanout.h"
+#include "interp.h"
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <climits>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 #include <cerrno>
 #include <cstring>
+#include <functional>
 #include <iostream>
 using namespace std;
+extern char** environ;
 string SHELL_HOME; // set in main()
+static bool in_subshell = false;
+
+void exec_in_subshell() {
+    in_subshell = true;
+    jobs_own();
+}
 
 string build_cmd_string(const Parsed& p) {
     string s;
     for (size_t i=0; i<p.stages.size(); ++i) {
         auto& st = p.stages[i];
+        for (auto& a : st.assigns) {
+            if (!s.empty() && s.back()!=' ') s.push_back(' ');
+            s += a;
+        }
         for (size_t j=0; j+1<st.argv.size(); ++j) {
             if (st.argv[j]) {
                 if (!s.empty() && s.back()!=' ') s.push_back(' ');
                 s += st.argv[j];
             }
         }
-        if (i+1<p.stages.size()) s += " |";
+        if (i+1<p.stages.size()) s += st.meter ? " |>" : " |";
         if (!st.infile.empty()){ s += " < "; s += st.infile; }
         if (!st.outfile.empty()){ s += st.append? " >> " : " > "; s += st.outfile; }
+        if (!st.here_delim.empty()){ s += " << "; s += st.here_delim; }
+    }
+    if (!p.fanout.empty()) {
+        s += " |{";
+        for (size_t k=0; k<p.fanout.size(); ++k) s += (k ? " ; " : " ") + build_cmd_string(p.fanout[k]);
+        s += " }";
     }
     if (p.background) s += " &";
     return s;
 }
 
+// An fd reading back `body`, without touching the filesystem. Small bodies
+// fit in a pipe without blocking; larger ones go to a memfd (or a writer
+// process where memfd_create is unavailable).
+static int here_fd(const string& body) {
+    int pfd[2];
+#ifdef __linux__
+    if (body.size() > PIPE_BUF) {
+        int fd = memfd_create("mysh-heredoc", MFD_CLOEXEC);
+        if (fd >= 0) {
+            size_t off = 0;
+            while (off < body.size()) {
+                ssize_t w = write(fd, body.data() + off, body.size() - off);
+                if (w < 0) { if (errno == EINTR) continue; close(fd); return -1; }
+                off += (size_t)w;
+            }
+            lseek(fd, 0, SEEK_SET);
+            return fd;
+        }
+    }
+#endif
+    if (pipe(pfd) < 0) return -1;
+    if (body.size() > PIPE_BUF) {
+        // Runs in the stage child, which is about to exec: the writer is
+        // forked twice so that init reaps it, not the command.
+        pid_t w = fork();
+        if (w == 0) {
+            if (fork() == 0) {
+                close(pfd[0]);
+                (void)!write(pfd[1], body.data(), body.size());
+            }
+            _exit(0);
+        }
+        if (w > 0) while (waitpid(w, nullptr, 0) < 0 && errno == EINTR) {}
+    } else {
+        (void)!write(pfd[1], body.data(), body.size());
+    }
+    close(pfd[1]);
+    return pfd[0];
+}
+
 static void apply_redirs(const CmdStage& st) {
     if (!st.infile.empty()) {
         int fd = open(st.infile.c_str(), O_RDONLY);
@@ -37,6 +112,12 @@ static void apply_redirs(const CmdStage& st) {
         if (dup2(fd, STDIN_FILENO)<0){ perror("dup2 <"); _exit(1); }
         close(fd);
     }
+    if (st.has_here) {
+        int fd = here_fd(st.here_body);
+        if (fd<0){ perror("here-document"); _exit(1); }
+        if (dup2(fd, STDIN_FILENO)<0){ perror("dup2 <<"); _exit(1); }
+        close(fd);
+    }
     if (!st.outfile.empty()) {
         int flags = O_WRONLY | O_CREAT | (st.append? O_APPEND : O_TRUNC);
         int fd = open(st.outfile.c_str(), flags, 0644);
@@ -46,72 +127,387 @@ static void apply_redirs(const CmdStage& st) {
     }
 }
 
-void run_parsed(Parsed& p) {
-    int n = (int)p.stages.size();
+// Expand $VAR, then wildcards; argv strings are malloc'd by the parser.
+// A pattern with no matches is passed through unchanged.
+static void expand_stage(CmdStage& st) {
+    for (auto& a : st.assigns) a = expand_vars(a, true);
+    if (st.has_here && st.here_expand) st.here_body = expand_vars(st.here_body);
+    if (!procsub_kind(st.infile.c_str())) st.infile = expand_vars(st.infile, true);
+    if (!procsub_kind(st.outfile.c_str())) st.outfile = expand_vars(st.outfile, true);
+    vector<char*> out;
+    for (char* arg : st.argv) {
+        if (!arg) continue;
+        if (procsub_kind(arg)) { out.push_back(arg); continue; } // expanded by its subshell
+        bool quoted = strpbrk(arg, "'\"");
+        if (quoted || strchr(arg, '$')) {
+            string e = expand_vars(arg, true);
+            free(arg);
+            arg = strdup(e.c_str());
+        }
+        if (out.empty() || quoted || !has_glob_meta(arg)) { out.push_back(arg); continue; }
+        vector<string> hits = glob_expand(arg);
+        if (hits.empty()) { out.push_back(arg); continue; }
+        free(arg);
+        for (auto& h : hits) out.push_back(strdup(h.c_str()));
+    }
+    out.push_back(nullptr);
+    st.argv.swap(out);
+}
+
+// Plain external stages (no file redirections or here-docs) can be handed
+// to a parked zygote child; returns -1 when the stage must be forked.
+static pid_t spawn_via_zygote(CmdStage& st, int in, int out, pid_t pgid) {
+    if (!zygote_active() || !st.argv[0] || builtin_flags(st.argv[0])) return -1;
+    if (!st.infile.empty() || !st.outfile.empty() || st.has_here) return -1;
+    vector<char*> env_scratch;
+    char** envp = env_with_overrides(st.assigns, env_scratch);
+    return zygote_spawn(st.argv.data(), envp, in < 0 ? STDIN_FILENO : in, out < 0 ? STDOUT_FILENO : out,
+                        STDERR_FILENO, pgid);
+}
+
+// Prefixes in front of a pipeline, in any order: `limit [options]` runs
+// the job in its own cgroup, `pin [options]` places it on CPUs/a NUMA node.
+// Their options are taken off the first stage and apply to the whole job.
+struct JobPrefix {
+    bool limited = false, pinned = false;
+    CgLimits lim;
+    Placement pl;
+    string words; // as typed, kept in the job's command
+};
+
+// Returns -1 without a prefix (`limit %n` is the builtin), else a status.
+static int take_job_prefix(CmdStage& st, JobPrefix& jp) {
+    int rc = -1;
+    while (st.argv[0]) {
+        bool limit = strcmp(st.argv[0], "limit") == 0;
+        if (!limit && strcmp(st.argv[0], "pin") != 0) break;
+        int k = limit ? cgroup_parse_limits(st.argv.data(), jp.lim, "limit")
+                      : placement_parse(st.argv.data(), jp.pl, "pin");
+        if (k < 0) return 2;
+        if (!st.argv[k] || (limit && st.argv[k][0] == '%')) break;
+        (limit ? jp.limited : jp.pinned) = true;
+        for (int i = 0; i < k; i++) {
+            jp.words += st.argv[i];
+            jp.words += ' ';
+            free(st.argv[i]);
+        }
+        st.argv.erase(st.argv.begin(), st.argv.begin() + k);
+        rc = 0;
+    }
+    return rc;
+}
+
+// Process substitution: a <(cmd) or >(cmd) word becomes /dev/fd/N, N being
+// the stage's end of a pipe to a subshell running cmd. The subshells are
+// part of the job, so they are waited for and reaped with it.
+struct ProcSub {
+    int stage;
+    int stage_end; // inherited by that stage only
+    int sub_end;   // the subshell's stdout for <(), stdin for >()
+    char kind;
+    string text;   // cmd
+};
+
+static bool take_procsub(int i, string& w, vector<ProcSub>& subs) {
+    char kind = procsub_kind(w.c_str());
+    if (!kind) return true;
+    int fd[2];
+    if (pipe(fd)<0) return false;
+    int stage_end = kind == '<' ? fd[0] : fd[1];
+    subs.push_back({i, stage_end, kind == '<' ? fd[1] : fd[0], kind, w.substr(2, w.size() - 3)});
+    w = "/dev/fd/" + to_string(stage_end);
+    return true;
+}
+
+// Covers argv and the < > targets (`cmd < <(gen)`).
+static bool take_procsubs(const vector<CmdStage*>& sts, vector<ProcSub>& subs) {
+    for (size_t i=0; i<sts.size(); ++i) {
+        CmdStage& st = *sts[i];
+        for (char*& a : st.argv) {
+            if (!procsub_kind(a)) continue;
+            string w = a;
+            if (!take_procsub((int)i, w, subs)) return false;
+            free(a);
+            a = strdup(w.c_str());
+        }
+        if (!take_procsub((int)i, st.infile, subs) || !take_procsub((int)i, st.outfile, subs)) return false;
+    }
+    return true;
+}
+
+// Forks the subshell for s into pgid (0: a new group); child_setup does
+// the per-job placement. close_fds are every other pipe end of the job.
+static pid_t spawn_procsub(const ProcSub& s, const vector<int>& close_fds, pid_t pgid, int cgfd,
+                           const function<void(int)>& child_setup) {
+    pid_t pid = cgroup_fork(cgfd);
+    if (pid > 0) setpgid(pid, pgid ? pgid : pid);
+    if (pid != 0) return pid;
+    child_setup(s.stage);
+    zygote_detach();
+    exec_in_subshell();
+    setpgid(0, pgid);
+    dup2(s.sub_end, s.kind == '<' ? STDOUT_FILENO : STDIN_FILENO);
+    for (int fd: close_fds) close(fd);
+    Node root;
+    string err;
+    if (parse_script(s.text, root, err, true) != PARSE_OK) {
+        cerr << "mysh: " << err << "\n";
+        _exit(2);
+    }
+    int rc = run_tree(root);
+    cout.flush();
+    fflush(stdout);
+    _exit(rc);
+}
+
+static const char* stage_name(const CmdStage* st) {
+    return st->argv[0] ? st->argv[0] : "(redirect)";
+}
+
+int run_parsed(Parsed& p) {
+    // The producer's stages, then each |{ } branch's, spawned as one job.
+    vector<CmdStage*> sts;
+    vector<int> seg_end; // one past the last stage of each segment
+    for (auto& st : p.stages) sts.push_back(&st);
+    seg_end.push_back((int)sts.size());
+    for (auto& b : p.fanout) {
+        for (auto& st : b.stages) sts.push_back(&st);
+        seg_end.push_back((int)sts.size());
+    }
+    int n = (int)sts.size();
+    for (CmdStage* st : sts) expand_stage(*st);
+
+    JobPrefix jp;
+    int prc = take_job_prefix(p.stages[0], jp);
+    if (prc > 0) return prc;
+
+    // --- Case 0: bare VAR=value sets shell variables ---
+    if (n == 1 && !p.stages[0].argv[0]) {
+        for (auto& a : p.stages[0].assigns) {
+            size_t eq = a.find('=');
+            var_set(a.substr(0, eq), a.substr(eq + 1));
+        }
+        return 0;
+    }
+
+    string cmd = jp.words + build_cmd_string(p);
+    vector<ProcSub> subs;
+    if (!take_procsubs(sts, subs)) {
+        perror("pipe");
+        for (auto& s : subs) { close(s.stage_end); close(s.sub_end); }
+        return 1;
+    }
 
     // --- Case 1: Single builtin command, no pipe ---
-    if (n == 1 && p.stages[0].argv.size()>0 && p.stages[0].argv[0]) {
-        string cmd = p.stages[0].argv[0];
-        if (is_builtin(cmd)) {
+    if (n == 1 && prc < 0 && subs.empty() && p.stages[0].argv.size()>0 && p.stages[0].argv[0]) {
+        if (builtin_flags(p.stages[0].argv[0]) & MYSH_BI_PARENT) {
             // run directly in parent
-            builtin_dispatch(p.stages[0].argv.data());
-            return;
+            int rc = builtin_dispatch(p.stages[0].argv.data());
+            return rc < 0 ? 1 : rc;
         }
     }
 
     // --- Case 2: Pipeline or external command(s) ---
-    vector<int> fds(2*max(0,n-1), -1);
-    for (int i=0; i<n-1; ++i) {
-        if (pipe(&fds[2*i])<0){ perror("pipe"); return; }
+    string cgroup;
+    int cgfd = -1;
+    vector<int> sub_ends;
+    for (auto& s : subs) sub_ends.insert(sub_ends.end(), {s.stage_end, s.sub_end});
+    if (jp.limited) {
+        cgroup = cgroup_create(jp.lim, "limit");
+        cgfd = cgroup.empty() ? -1 : cgroup_open(cgroup);
+        if (cgfd < 0) {
+            for (int fd: sub_ends) close(fd);
+            cgroup_release(cgroup);
+            return 1;
+        }
     }
 
-    pid_t pgid = 0;
+    // Per-stage stdin/stdout (-1: the shell's). pipe_ends are the stages'
+    // ends, closed by the shell once the children have them; relay_ends go to
+    // the shell's relay threads and are CLOEXEC so later spawns don't hold a
+    // hop open.
+    // A |> hop gets a second pipe: stage i writes into the first as usual,
+    // the relay reads it and feeds the second one to stage i+1.
+    vector<int> in_fd(n, -1), out_fd(n, -1), pipe_ends, relay_ends;
+    struct Hop { int in, out; string label; };
+    vector<Hop> hops;
+    int fan_in = -1;
+    vector<int> fan_outs;
+    vector<string> fan_labels;
+    auto fail = [&](const char* what) {
+        perror(what);
+        for (int fd: pipe_ends) close(fd);
+        for (int fd: relay_ends) close(fd);
+        for (int fd: sub_ends) close(fd);
+        if (cgfd >= 0) close(cgfd);
+        cgroup_release(cgroup);
+        return 1;
+    };
+    auto relay_pipe = [&](int fd[2]) {
+        if (pipe(fd)<0) return false;
+        fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+        return true;
+    };
+    for (size_t s=0, i=0; s<seg_end.size(); i = seg_end[s++]) {
+        for (; (int)i+1 < seg_end[s]; ++i) {
+            int a[2];
+            if (!sts[i]->meter) {
+                if (pipe(a)<0) return fail("pipe");
+                pipe_ends.insert(pipe_ends.end(), {a[0], a[1]});
+                out_fd[i] = a[1];
+                in_fd[i+1] = a[0];
+                continue;
+            }
+            int y[2];
+            if (!relay_pipe(a)) return fail("pipe");
+            pipe_ends.push_back(a[1]);
+            relay_ends.push_back(a[0]);
+            if (!relay_pipe(y)) return fail("pipe");
+            pipe_ends.push_back(y[0]);
+            relay_ends.push_back(y[1]);
+            out_fd[i] = a[1];
+            hops.push_back({a[0], y[1], string(stage_name(sts[i])) + " |> " + stage_name(sts[i+1])});
+            in_fd[i+1] = y[0];
+        }
+    }
+    // Fan-out: the producer's last stage and each branch's first stage talk
+    // to the relay through their own pipes.
+    if (!p.fanout.empty()) {
+        int a[2];
+        if (!relay_pipe(a)) return fail("pipe");
+        pipe_ends.push_back(a[1]);
+        relay_ends.push_back(a[0]);
+        fan_in = a[0];
+        out_fd[seg_end[0]-1] = a[1];
+        for (size_t k=0; k<p.fanout.size(); ++k) {
+            if (!relay_pipe(a)) return fail("pipe");
+            pipe_ends.push_back(a[0]);
+            relay_ends.push_back(a[1]);
+            in_fd[seg_end[k]] = a[0];
+            fan_outs.push_back(a[1]);
+            fan_labels.push_back(string(stage_name(sts[seg_end[0]-1])) + " |{ " + stage_name(sts[seg_end[k]]));
+        }
+    }
+
+    // Resolve commands from the warmed PATH index while still in the parent
+    vector<const char*> resolved(n, nullptr);
     for (int i=0; i<n; ++i) {
-        pid_t pid = fork();
-        if (pid<0){ perror("fork"); return; }
+        bool path_override = false;
+        for (auto& a : sts[i]->assigns) if (a.compare(0, 5, "PATH=") == 0) path_override = true;
+        const char* name = sts[i]->argv[0];
+        if (!path_override && name && !builtin_flags(name)) resolved[i] = path_resolve(name);
+    }
+
+    BgPolicy bgpol;
+    bool demote = p.background && bgsched_policy(bgpol);
+
+    env_block(); // make sure the cached envp is current before forking
+    cout.flush(); // don't let children inherit buffered shell output
+    auto child_setup = [&](int i) {
+        relay_close_inherited(); // other jobs' relays
+        if (cgfd >= 0) close(cgfd);
+        if (jp.pinned) placement_apply(jp.pl, i);
+        if (demote) bgsched_apply(bgpol, 0);
+        reactor_child_reset();
+    };
+    pid_t pgid = in_subshell ? getpgrp() : 0, last_pid = 0;
+    // A failed fork leaves nothing behind: started processes, fds, the cgroup.
+    vector<pid_t> started;
+    auto abort_spawn = [&](bool sub_ends_open) {
+        perror("fork");
+        for (pid_t pid : started) kill(pid, SIGKILL);
+        for (pid_t pid : started) waitpid(pid, nullptr, 0);
+        for (int fd: pipe_ends) close(fd);
+        for (int fd: relay_ends) close(fd);
+        for (auto& s : subs) {
+            close(s.stage_end);
+            if (sub_ends_open) close(s.sub_end);
+        }
+        if (cgfd >= 0) close(cgfd);
+        cgroup_release(cgroup);
+        return 1;
+    };
+
+    // Substitutions first, so /dev/fd/N has a writer (reader) when the stage opens it.
+    vector<int> sub_close = pipe_ends;
+    sub_close.insert(sub_close.end(), relay_ends.begin(), relay_ends.end());
+    sub_close.insert(sub_close.end(), sub_ends.begin(), sub_ends.end());
+    vector<bool> has_sub(n, false);
+    for (auto& s : subs) {
+        pid_t pid = spawn_procsub(s, sub_close, pgid, cgfd, child_setup);
+        if (pid<0) return abort_spawn(true);
+        started.push_back(pid);
+        if (pgid==0) pgid = pid;
+        has_sub[s.stage] = true;
+    }
+    for (auto& s : subs) close(s.sub_end);
+
+    for (int i=0; i<n; ++i) {
+        CmdStage& st = *sts[i];
+        // A demoted stage is forked like a pinned one, so it is demoted before exec.
+        pid_t pid = prc < 0 && !demote && !has_sub[i] ? spawn_via_zygote(st, in_fd[i], out_fd[i], pgid) : -1;
+        if (pid<0) pid = cgroup_fork(cgfd);
+        if (pid<0) return abort_spawn(false);
         if (pid==0) {
+            child_setup(i);
             if (pgid==0) pgid = getpid();
             setpgid(0, pgid);
 
-            if (i>0) dup2(fds[2*(i-1)], STDIN_FILENO);
-            if (i<n-1) dup2(fds[2*i+1], STDOUT_FILENO);
+            if (in_fd[i] >= 0) dup2(in_fd[i], STDIN_FILENO);
+            if (out_fd[i] >= 0) dup2(out_fd[i], STDOUT_FILENO);
 
-            for (int fd: fds) if (fd!=-1) close(fd);
+            for (int fd: pipe_ends) close(fd);
+            for (int fd: relay_ends) close(fd);
+            for (auto& s : subs) if (s.stage != i) close(s.stage_end);
 
-            apply_redirs(p.stages[i]);
+            apply_redirs(st);
 
-            // Run builtin inside child (useful for pipelines)
-            if (is_builtin(p.stages[i].argv[0])) {
-                builtin_dispatch(p.stages[i].argv.data());
-                _exit(0);
+            if (!st.argv[0]) _exit(0);
+
+            // Run builtin inside child (useful for pipelines) when it allows
+            // that; otherwise fall back to an external command of that name
+            int bflags = builtin_flags(st.argv[0]);
+            if ((bflags & MYSH_BI_PIPELINE) || (n == 1 && bflags)) {
+                int rc = builtin_dispatch(st.argv.data());
+                cout.flush();
+                fflush(stdout);
+                _exit(rc < 0 ? 1 : rc);
             } else {
-                execvp(p.stages[i].argv[0], p.stages[i].argv.data());
-                perror(p.stages[i].argv[0]);
+                vector<char*> env_scratch;
+                environ = env_with_overrides(st.assigns, env_scratch);
+                if (resolved[i]) execv(resolved[i], st.argv.data());
+                execvp(st.argv[0], st.argv.data());
+                perror(st.argv[0]);
                 _exit(127);
             }
         } else {
             if (pgid==0) pgid = pid;
             setpgid(pid, pgid);
+            last_pid = pid;
+            started.push_back(pid);
         }
     }
 
-    for (int fd: fds) if (fd!=-1) close(fd);
+    for (int fd: pipe_ends) close(fd);
+    for (auto& s : subs) close(s.stage_end);
+    if (cgfd >= 0) close(cgfd);
 
+    // The stages hold their ends now; hand the rest to the relays.
+    vector<shared_ptr<HopStats>> meters;
+    for (auto& h : hops) meters.push_back(meter_start(h.in, h.out, h.label));
+    if (fan_in >= 0) {
+        const char* policy = var_get("FANOUT");
+        auto fan = fanout_start(fan_in, fan_outs, fan_labels, policy && strcmp(policy, "drop") == 0);
+        meters.insert(meters.end(), fan.begin(), fan.end());
+    }
+    int id = job_add(pgid, last_pid, n + (int)subs.size(), cmd);
+    if (jp.limited) job_set_cgroup(id, cgroup);
+    if (demote) job_set_demoted(id);
+    if (!meters.empty()) job_set_meters(id, meters);
     if (p.background) {
-        cout << "[bg] " << pgid << "\n";
-        return;
-    }
-
-    FG_PGID = pgid;
-    int status;
-    while (true) {
-        pid_t w = waitpid(-pgid, &status, WUNTRACED);
-        if (w==-1) {
-            if (errno==ECHILD) break;
-            if (errno==EINTR) continue;
-            break;
-        }
-        if (WIFSTOPPED(status)) break;
+        cout << "[" << id << "] " << pgid << "\n";
+        return 0;
     }
-    FG_PGID = 0;
+    return job_wait_fg(id);
 }
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "fanout.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+using namespace std;
+
+struct Branch {
+    int fd;
+    shared_ptr<HopStats> s;
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Blocking write of the part a short tee() left out; false once the
+// branch is gone.
+static bool write_all(int fd, const char* p, size_t n) {
+    while (n) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+static void close_branch(Branch& b) {
+    if (b.fd < 0) return;
+    relay_close(b.fd);
+    b.fd = -1;
+}
+
+static void fan_relay(int in, vector<Branch> br, bool drop) {
+    static const size_t CHUNK = 1 << 20;
+    vector<char> copy;
+#ifdef __linux__
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+#endif
+    while (true) {
+        // Wait for room in every branch (block) or in any branch (drop), timing
+        // whatever holds us up. ready[k]: branch k takes the whole chunk.
+        vector<struct pollfd> po;
+        for (auto& b : br) po.push_back({b.fd, POLLOUT, 0});
+        vector<bool> ready(br.size(), true);
+        for (size_t k = 0; k < (drop ? 1 : br.size()); k++) {
+            if (!drop && br[k].fd < 0) continue;
+            struct pollfd* w = drop ? po.data() : &po[k];
+            nfds_t nw = drop ? po.size() : 1;
+            if (poll(w, nw, 0) != 0) continue;
+            uint64_t t0 = now_ns();
+            while (poll(w, nw, -1) < 0 && errno == EINTR) {}
+            for (size_t j = drop ? 0 : k; j < (drop ? br.size() : k + 1); j++) {
+                if (br[j].fd < 0) continue;
+                br[j].s->stalls++;
+                br[j].s->stall_ns += now_ns() - t0;
+            }
+        }
+        for (size_t k = 0; k < br.size(); k++) {
+            if (po[k].revents & (POLLERR | POLLNVAL)) close_branch(br[k]);
+            if (drop) ready[k] = po[k].revents & POLLOUT;
+        }
+        if (none_of(br.begin(), br.end(), [](const Branch& b) { return b.fd >= 0; })) break;
+
+        struct pollfd pi = {in, POLLIN, 0};
+        while (poll(&pi, 1, -1) < 0 && errno == EINTR) {}
+        int avail = 0;
+        if (ioctl(in, FIONREAD, &avail) < 0 || avail <= 0) {
+            if (pi.revents & (POLLHUP | POLLERR | POLLNVAL)) break; // producer done
+            continue;
+        }
+        size_t len = min((size_t)avail, CHUNK);
+
+        // Each branch gets a reference to the same pages; a short tee (branch
+        // pipe nearly full) is finished from a user-space copy below.
+        vector<size_t> got(br.size(), len);
+        bool short_tee = false;
+        for (size_t k = 0; k < br.size(); k++) {
+            if (br[k].fd < 0) continue;
+#ifdef __linux__
+            ssize_t t = tee(in, br[k].fd, len, SPLICE_F_NONBLOCK);
+            if (t < 0 && errno == EPIPE) { close_branch(br[k]); continue; }
+            got[k] = t < 0 ? 0 : (size_t)t;
+#else
+            got[k] = 0;
+#endif
+            if (got[k] < len) short_tee = true;
+        }
+
+        // Consume the chunk from the producer's pipe.
+        bool consumed = false;
+#ifdef __linux__
+        if (!short_tee && devnull >= 0) {
+            size_t left = len;
+            while (left) {
+                ssize_t m = splice(in, nullptr, devnull, nullptr, left, SPLICE_F_MOVE);
+                if (m < 0 && errno == EINTR) continue;
+                if (m <= 0) break;
+                left -= (size_t)m;
+            }
+            consumed = left == 0;
+        }
+#endif
+        if (!consumed) {
+            copy.resize(len);
+            size_t have = 0;
+            while (have < len) {
+                ssize_t m = read(in, copy.data() + have, len - have);
+                if (m < 0 && errno == EINTR) continue;
+                if (m <= 0) break;
+                have += (size_t)m;
+            }
+            len = have;
+        }
+        for (size_t k = 0; k < br.size(); k++) {
+            Branch& b = br[k];
+            if (b.fd < 0) continue;
+            if (got[k] < len) {
+                if (!ready[k]) {
+                    b.s->dropped += len - got[k];
+                    b.s->bytes += got[k];
+                    continue;
+                }
+                if (!write_all(b.fd, copy.data() + got[k], len - got[k])) { close_branch(b); continue; }
+            }
+            b.s->bytes += len;
+        }
+    }
+#ifdef __linux__
+    if (devnull >= 0) close(devnull);
+#endif
+    relay_close(in);
+    for (auto& b : br) {
+        close_branch(b);
+        meter_finish(*b.s);
+    }
+}
+
+vector<shared_ptr<HopStats>> fanout_start(int in_fd, const vector<int>& outs, const vector<string>& labels, bool drop) {
+    vector<shared_ptr<HopStats>> stats;
+    vector<Branch> br;
+    relay_track(in_fd);
+    for (size_t k = 0; k < outs.size(); k++) {
+        relay_track(outs[k]);
+        auto s = make_shared<HopStats>();
+        s->label = labels[k];
+        s->summary = false;
+        clock_gettime(CLOCK_MONOTONIC, &s->start);
+        stats.push_back(s);
+        br.push_back({outs[k], s});
+    }
+    relay_spawn([in_fd, br, drop] { fan_relay(in_fd, br, drop); });
+    return stats;
+}
@@ -0,0 +1,62 @@
+#include "frame.h"
+#include <unistd.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+using namespace std;
+
+static bool read_full(int fd, char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t r = read(fd, buf, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf += r;
+        n -= (size_t)r;
+    }
+    return true;
+}
+
+// Header and payload go out in one writev.
+bool write_frame(int fd, char type, const char* data, uint32_t len) {
+    if (len > FRAME_MAX) { errno = EMSGSIZE; return false; }
+    char hdr[5];
+    uint32_t nlen = htonl(len);
+    hdr[0] = type;
+    memcpy(hdr + 1, &nlen, 4);
+    struct iovec iov[2] = {{hdr, sizeof(hdr)}, {(void*)data, len}};
+    size_t total = sizeof(hdr) + len;
+    int cnt = len ? 2 : 1;
+    struct iovec* v = iov;
+    while (total > 0) {
+        ssize_t w = writev(fd, v, cnt);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        total -= (size_t)w;
+        while (cnt > 0 && (size_t)w >= v->iov_len) { w -= (ssize_t)v->iov_len; ++v; --cnt; }
+        if (cnt > 0) { v->iov_base = (char*)v->iov_base + w; v->iov_len -= (size_t)w; }
+    }
+    return true;
+}
+
+bool write_exit_frame(int fd, int status) {
+    uint32_t st = htonl((uint32_t)status);
+    return write_frame(fd, FRAME_EXIT, (const char*)&st, 4);
+}
+
+bool read_frame(int fd, char& type, string& payload) {
+    char hdr[5];
+    if (!read_full(fd, hdr, sizeof(hdr))) return false;
+    uint32_t nlen;
+    memcpy(&nlen, hdr + 1, 4);
+    type = hdr[0];
+    if (ntohl(nlen) > FRAME_MAX) { errno = EMSGSIZE; return false; }
+    payload.resize(ntohl(nlen));
+    return payload.empty() || read_full(fd, &payload[0], payload.size());
+}
+
+int exit_frame_status(const string& payload) {
+    uint32_t st = 0;
+    if (payload.size() == 4) memcpy(&st, payload.data(), 4);
+    return (int)ntohl(st);
+}
@@ -0,0 +1,154 @@
+#include "fuzzy.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <thread>
+using namespace std;
+
+static const size_t PARALLEL_MIN = 8192; // candidates per thread before splitting
+
+// Scoring, close to fzf's: every matched character earns a base score,
+// more at word boundaries and in runs; gaps cost a little.
+enum {
+    SCORE_MATCH = 16,
+    BONUS_BOUNDARY = 8,
+    BONUS_FIRST = 8,
+    BONUS_CONSECUTIVE = 4,
+    PENALTY_GAP_START = 3,
+    PENALTY_GAP_EXTEND = 1
+};
+
+static uint64_t char_bit(unsigned char c) {
+    c = (unsigned char)tolower(c);
+    if (c >= 'a' && c <= 'z') return 1ull << (c - 'a');
+    if (c >= '0' && c <= '9') return 1ull << (26 + c - '0');
+    return 1ull << (36 + c % 28);
+}
+
+static uint64_t char_mask(const string& s) {
+    uint64_t m = 0;
+    for (unsigned char c : s) m |= char_bit(c);
+    return m;
+}
+
+static bool boundary(const char* s, size_t i) {
+    if (i == 0) return true;
+    char p = s[i - 1];
+    if (p == '/' || p == '_' || p == '-' || p == '.' || p == ' ') return true;
+    return islower((unsigned char)p) && isupper((unsigned char)s[i]); // camelCase
+}
+
+// Smart case: an uppercase letter in the pattern makes the match exact.
+static bool eq(char p, char t, bool exact) {
+    return exact ? p == t : tolower((unsigned char)p) == tolower((unsigned char)t);
+}
+
+static int score_in(const char* pat, size_t plen, const char* s, size_t len, bool exact) {
+    if (plen == 0) return 0;
+    // Forward: the earliest window end; memchr finds the first character
+    const char* first = (const char*)memchr(s, exact ? pat[0] : tolower((unsigned char)pat[0]), len);
+    if (!exact && isalpha((unsigned char)pat[0])) {
+        const char* up = (const char*)memchr(s, toupper((unsigned char)pat[0]), first ? (size_t)(first - s) : len);
+        if (up) first = up;
+    }
+    if (!first) return -1;
+    size_t i = (size_t)(first - s);
+    size_t pi = 0;
+    for (; i < len && pi < plen; ++i)
+        if (eq(pat[pi], s[i], exact)) ++pi;
+    if (pi < plen) return -1;
+    size_t end = i;
+    // Backward from there: the shortest window ending at `end`
+    size_t start = end;
+    pi = plen;
+    while (pi > 0) {
+        --start;
+        if (eq(pat[pi - 1], s[start], exact)) --pi;
+    }
+
+    int score = 0;
+    bool in_gap = false, prev_match = false;
+    pi = 0;
+    for (size_t k = start; k < end; ++k) {
+        if (pi < plen && eq(pat[pi], s[k], exact)) {
+            score += SCORE_MATCH;
+            if (boundary(s, k)) score += BONUS_BOUNDARY + (pi == 0 ? BONUS_FIRST : 0);
+            if (prev_match) score += BONUS_CONSECUTIVE;
+            prev_match = true;
+            in_gap = false;
+            ++pi;
+        } else {
+            score -= in_gap ? PENALTY_GAP_EXTEND : PENALTY_GAP_START;
+            in_gap = true;
+            prev_match = false;
+        }
+    }
+    if (start == 0) score += BONUS_FIRST;
+    return score;
+}
+
+static bool has_upper(const string& s) {
+    for (unsigned char c : s) if (isupper(c)) return true;
+    return false;
+}
+
+int fuzzy_score(const string& pattern, const string& text) {
+    return score_in(pattern.data(), pattern.size(), text.data(), text.size(), has_upper(pattern));
+}
+
+void FuzzyIndex::assign(vector<string> c) {
+    cands = move(c);
+    masks.resize(cands.size());
+    for (size_t i = 0; i < cands.size(); ++i) masks[i] = char_mask(cands[i]);
+}
+
+struct Hit {
+    int score;
+    uint32_t idx;
+};
+
+vector<string> FuzzyIndex::rank(const string& pattern, size_t limit) const {
+    uint64_t need = char_mask(pattern);
+    bool exact = has_upper(pattern);
+    size_t n = cands.size();
+
+    auto scan = [&](size_t lo, size_t hi, vector<Hit>& out) {
+        const uint64_t* m = masks.data();
+        for (size_t i = lo; i < hi; ++i) {
+            if ((m[i] & need) != need) continue; // cheap reject, no character work
+            const string& c = cands[i];
+            int s = score_in(pattern.data(), pattern.size(), c.data(), c.size(), exact);
+            if (s >= 0) out.push_back({s, (uint32_t)i});
+        }
+    };
+
+    vector<Hit> hits;
+    unsigned nthreads = max(1u, thread::hardware_concurrency());
+    nthreads = (unsigned)min<size_t>(nthreads, n / PARALLEL_MIN);
+    if (nthreads <= 1) {
+        scan(0, n, hits);
+    } else {
+        vector<vector<Hit>> part(nthreads);
+        vector<thread> workers;
+        size_t chunk = (n + nthreads - 1) / nthreads;
+        for (unsigned t = 0; t < nthreads; ++t)
+            workers.emplace_back(scan, t * chunk, min(n, (t + 1) * chunk), ref(part[t]));
+        for (auto& w : workers) w.join();
+        for (auto& p : part) hits.insert(hits.end(), p.begin(), p.end());
+    }
+
+    auto better = [&](const Hit& a, const Hit& b) {
+        if (a.score != b.score) return a.score > b.score;
+        const string& x = cands[a.idx];
+        const string& y = cands[b.idx];
+        if (x.size() != y.size()) return x.size() < y.size();
+        return x < y;
+    };
+    size_t k = min(limit, hits.size());
+    partial_sort(hits.begin(), hits.begin() + k, hits.end(), better);
+
+    vector<string> out;
+    out.reserve(k);
+    for (size_t i = 0; i < k; ++i) out.push_back(cands[hits[i].idx]);
+    return out;
+}
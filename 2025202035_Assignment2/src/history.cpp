@@ -1,9 +1,149 @@
-
 #include "history.h"
 #include "arrow.h"
+#include "common.h"
+#include "vars.h"
+#include "histmeta.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
 using namespace std;
+
+// ---------- Sidecar ----------
+// Format and file handling are in histmeta.h.
+
+// Index, built once from the sidecar and kept current by history_record().
+struct CmdTimes {
+    vector<uint32_t> ms; // sorted, for percentiles
+    uint64_t total_ms = 0;
+    unsigned fails = 0;
+};
+static vector<Rec> recs;
+static multimap<uint32_t, size_t, greater<uint32_t>> by_duration; // slowest first
+static vector<size_t> failed;
+static unordered_map<string, CmdTimes> by_cmd; // first word of the line
+static bool loaded = false;
+
+static string meta_path() {
+    return string(getenv("HOME") ? getenv("HOME") : "") + "/.mysh_history_child.meta";
+}
+
+static string cmd_key(const string& cmd) {
+    istringstream in(cmd);
+    string w;
+    while (in >> w && is_assignment(w.c_str())) {}
+    return w;
+}
+
+static void index_rec(size_t i) {
+    const Rec& r = recs[i];
+    by_duration.emplace(r.h.dur_ms, i);
+    if (r.h.status) failed.push_back(i);
+    CmdTimes& c = by_cmd[cmd_key(r.cmd)];
+    c.ms.insert(upper_bound(c.ms.begin(), c.ms.end(), r.h.dur_ms), r.h.dur_ms);
+    c.total_ms += r.h.dur_ms;
+    if (r.h.status) c.fails++;
+}
+
+static void load_meta() {
+    loaded = true;
+    recs = meta_load(meta_path());
+    for (size_t i = 0; i < recs.size(); i++) index_rec(i);
+}
+
+void history_record(const string& cmd, const string& cwd, time_t start, double secs, int status, long peak_kb) {
+    if (!loaded) load_meta();
+    Rec r = meta_rec(cmd, cwd, start, secs, status, peak_kb);
+    meta_append(meta_path(), r);
+    recs.push_back(move(r));
+    index_rec(recs.size() - 1);
+}
+
+// ---------- Queries ----------
+static string fmt_ms(uint32_t ms) {
+    char buf[32];
+    if (ms < 60000) snprintf(buf, sizeof(buf), "%.2fs", ms / 1000.0);
+    else if (ms < 3600000) snprintf(buf, sizeof(buf), "%um%02us", ms / 60000, ms / 1000 % 60);
+    else snprintf(buf, sizeof(buf), "%uh%02um", ms / 3600000, ms / 60000 % 60);
+    return buf;
+}
+
+static void print_rec(const Rec& r) {
+    char when[32], line[96];
+    time_t t = r.h.start;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    snprintf(line, sizeof(line), "%s  %8s  %3u  %6s  ", when, fmt_ms(r.h.dur_ms).c_str(), r.h.status,
+             r.h.rss_kb ? human_bytes(r.h.rss_kb * 1024.0).c_str() : "-");
+    cout << line << r.cmd << "  (" << r.cwd << ")\n";
+}
+
+// Nearest rank.
+static uint32_t percentile(const vector<uint32_t>& ms, int p) {
+    size_t k = (ms.size() * p + 99) / 100;
+    return ms[k ? k - 1 : 0];
+}
+
+static void print_stats(const string& cmd, const CmdTimes& c) {
+    char line[128];
+    snprintf(line, sizeof(line), "%-16s %6zu %9s %9s %9s %9s %6u", cmd.c_str(), c.ms.size(), fmt_ms(percentile(c.ms, 50)).c_str(),
+             fmt_ms(percentile(c.ms, 95)).c_str(), fmt_ms(c.ms.back()).c_str(), fmt_ms((uint32_t)min<uint64_t>(c.total_ms, UINT32_MAX)).c_str(),
+             c.fails);
+    cout << line << "\n";
+}
+
+// history --slowest [N] | --failed [N] | --stats [CMD...]
+static int history_query(char** args) {
+    if (!loaded) load_meta();
+    string opt = args[1];
+    bool stats = opt == "--stats";
+    int n = 10;
+    if (!stats && args[2]) {
+        char* end;
+        n = (int)strtol(args[2], &end, 10);
+        if (*end || n <= 0 || args[3]) n = -1;
+    }
+    if ((opt != "--slowest" && opt != "--failed" && !stats) || n < 0) {
+        cerr << "usage: history [N | --slowest [N] | --failed [N] | --stats [CMD...]]\n";
+        return 2;
+    }
+    if (stats) {
+        cout << "command            runs       p50       p95       max     total failed\n";
+        if (args[2]) {
+            for (int i = 2; args[i]; i++) {
+                auto it = by_cmd.find(args[i]);
+                if (it == by_cmd.end()) cerr << "history: " << args[i] << ": not in history\n";
+                else print_stats(it->first, it->second);
+            }
+            return 0;
+        }
+        // The commands that took the most time overall.
+        vector<const pair<const string, CmdTimes>*> top;
+        for (auto& kv : by_cmd) top.push_back(&kv);
+        size_t k = min<size_t>(top.size(), 15);
+        partial_sort(top.begin(), top.begin() + k, top.end(),
+                     [](auto* a, auto* b) { return a->second.total_ms > b->second.total_ms; });
+        for (size_t i = 0; i < k; i++) print_stats(top[i]->first, top[i]->second);
+        return 0;
+    }
+    cout << "started              duration  st    peak  command (cwd)\n";
+    if (opt == "--slowest") {
+        for (auto it = by_duration.begin(); it != by_duration.end() && n-- > 0; ++it) print_rec(recs[it->second]);
+        return 0;
+    }
+    size_t from = failed.size() > (size_t)n ? failed.size() - n : 0;
+    for (size_t i = from; i < failed.size(); i++) print_rec(recs[failed[i]]);
+    return 0;
+}
+
 int show_history_builtin(char** args){
+    if (args[1] && strncmp(args[1], "--", 2) == 0) return history_query(args);
     int limit = 10; if (args[1]) limit = max(0, atoi(args[1]));
     const auto& hist = get_history();
     int total = (int)hist.size(); int start = total>limit? total-limit:0;
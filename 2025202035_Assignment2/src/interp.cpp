@@ -0,0 +1,205 @@
+#include "interp.h"
+#include "bgsched.h"
+#include "exec.h"
+#include "jobs.h"
+#include "pipemeter.h"
+#include "reactor.h"
+#include "signals.h"
+#include "vars.h"
+#include "wildcard.h"
+#include "zygote.h"
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+static bool exit_pending = false;
+static int exit_status = 0;
+static int last_status = 0;
+static int loop_depth = 0;
+static int break_levels = 0, continue_levels = 0;
+
+bool exit_requested() { return exit_pending; }
+
+// Stop at exit, at break/continue until their loop is reached, and after Ctrl+C.
+static bool unwinding() {
+    return exit_pending || break_levels || continue_levels || SHELL_INTERRUPTED;
+}
+
+// Loops made only of builtins never wait on a child, so a Ctrl+C waiting
+// in the reactor's signalfd is collected here, once per iteration.
+static bool interrupted() {
+    if (!SHELL_INTERRUPTED && reactor_active()) reactor_run_once(0);
+    return SHELL_INTERRUPTED;
+}
+
+// After a loop body: whether this loop stops.
+static bool loop_done() {
+    if (break_levels) { --break_levels; return true; }
+    if (continue_levels) return --continue_levels > 0;
+    return exit_pending || SHELL_INTERRUPTED;
+}
+
+static string word_arg(char* a) {
+    return expand_vars(a, true);
+}
+
+// break/continue [n] and exit [n] (or exitall) change control flow, so they are handled
+// here rather than as builtins. Returns false for any other command.
+static bool control_command(const Parsed& cmd, int& status) {
+    if (cmd.stages.size() != 1 || cmd.background) return false;
+    char* const* argv = cmd.stages[0].argv.data();
+    if (!argv[0]) return false;
+    bool is_break = strcmp(argv[0], "break") == 0;
+    if (is_break || strcmp(argv[0], "continue") == 0) {
+        int n = argv[1] ? atoi(word_arg(argv[1]).c_str()) : 1;
+        status = 0;
+        if (n < 1) {
+            cerr << argv[0] << ": " << argv[1] << ": loop count out of range\n";
+            status = 1;
+        } else if (loop_depth > 0) {
+            (is_break ? break_levels : continue_levels) = min(n, loop_depth);
+        }
+        return true;
+    }
+    if (strcmp(argv[0], "exitall") == 0) cout << "Exitall: terminating\n";
+    if (strcmp(argv[0], "exit") == 0 || strcmp(argv[0], "exitall") == 0) {
+        exit_status = argv[1] ? atoi(word_arg(argv[1]).c_str()) & 0xff : last_status;
+        exit_pending = true;
+        status = exit_status;
+        return true;
+    }
+    return false;
+}
+
+static vector<string> expand_words(const vector<string>& words) {
+    vector<string> out;
+    for (auto& w : words) {
+        string e = expand_vars(w, true);
+        vector<string> hits;
+        if (w.find_first_of("'\"") == string::npos && has_glob_meta(e)) hits = glob_expand(e);
+        if (hits.empty()) out.push_back(e);
+        else out.insert(out.end(), hits.begin(), hits.end());
+    }
+    return out;
+}
+
+static string describe(const Node& n) {
+    switch (n.kind) {
+        case N_PIPELINE: return build_cmd_string(n.cmd);
+        case N_ANDOR: return describe(n.kids[0]) + (n.ops[0] == '&' ? " && ..." : " || ...");
+        case N_NOT: return "! " + describe(n.kids[0]);
+        case N_IF: return "if ...";
+        case N_WHILE: return "while ...";
+        case N_UNTIL: return "until ...";
+        case N_FOR: return "for " + n.var + " ...";
+        default: return "...";
+    }
+}
+
+static int run_node(const Node& n);
+
+static int run_background(const Node& n) {
+    BgPolicy pol;
+    bool demote = bgsched_policy(pol);
+    cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return 1; }
+    if (pid == 0) {
+        if (demote) bgsched_apply(pol, 0); // inherited by everything it runs
+        reactor_child_reset();
+        relay_close_inherited();
+        zygote_detach();
+        exec_in_subshell();
+        setpgid(0, 0);
+        int rc = run_node(n);
+        cout.flush();
+        fflush(stdout);
+        _exit(exit_pending ? exit_status : rc);
+    }
+    setpgid(pid, pid);
+    int id = job_add(pid, pid, 1, describe(n) + " &");
+    if (demote) job_set_demoted(id);
+    cout << "[" << id << "] " << pid << "\n";
+    return 0;
+}
+
+static int eval(const Node& n) {
+    switch (n.kind) {
+    case N_PIPELINE: {
+        int status;
+        if (control_command(n.cmd, status)) return status;
+        Parsed p = copy_parsed(n.cmd); // run_parsed expands in place; keep the tree for the next iteration
+        status = run_parsed(p);
+        free_parsed(p);
+        return status;
+    }
+    case N_LIST: {
+        int status = last_status;
+        for (auto& k : n.kids) {
+            status = (k.background && k.kind != N_PIPELINE) ? run_background(k) : run_node(k);
+            if (unwinding()) break;
+        }
+        return status;
+    }
+    case N_ANDOR: {
+        int status = run_node(n.kids[0]);
+        for (size_t k = 1; k < n.kids.size() && !unwinding(); k++)
+            if ((status == 0) == (n.ops[k - 1] == '&')) status = run_node(n.kids[k]);
+        return status;
+    }
+    case N_NOT:
+        return run_node(n.kids[0]) == 0 ? 1 : 0;
+    case N_IF: {
+        size_t pairs = (n.kids.size() - (n.has_else ? 1 : 0)) / 2;
+        for (size_t i = 0; i < pairs; ++i) {
+            int cond = run_node(n.kids[2*i]);
+            if (unwinding()) return cond;
+            if (cond == 0) return run_node(n.kids[2*i + 1]);
+        }
+        return n.has_else ? run_node(n.kids.back()) : 0;
+    }
+    case N_WHILE:
+    case N_UNTIL: {
+        int status = 0;
+        ++loop_depth;
+        while (!interrupted()) {
+            int cond = run_node(n.kids[0]);
+            if (unwinding()) { if (loop_done()) break; continue; }
+            if ((cond == 0) != (n.kind == N_WHILE)) break;
+            status = run_node(n.kids[1]);
+            if (unwinding() && loop_done()) break;
+        }
+        --loop_depth;
+        return status;
+    }
+    case N_FOR: {
+        int status = 0;
+        ++loop_depth;
+        for (auto& w : expand_words(n.words)) {
+            if (interrupted()) break;
+            var_set(n.var, w);
+            status = run_node(n.kids[0]);
+            if (unwinding() && loop_done()) break;
+        }
+        --loop_depth;
+        return status;
+    }
+    }
+    return 0;
+}
+
+static int run_node(const Node& n) {
+    last_status = eval(n);
+    return last_status;
+}
+
+int run_tree(const Node& root) {
+    SHELL_INTERRUPTED = 0;
+    exit_pending = false;
+    break_levels = continue_levels = 0;
+    int status = run_node(root);
+    return exit_pending ? exit_status : status;
+}
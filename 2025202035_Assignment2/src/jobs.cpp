@@ -0,0 +1,358 @@
+#include "jobs.h"
+#include "signals.h"
+#include "reactor.h"
+#include "arrow.h"
+#include "cgroup.h"
+#include "bgsched.h"
+#include "pipemeter.h"
+#include <csignal>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+using namespace std;
+
+enum JobState { JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+
+struct Job {
+    pid_t pgid;
+    pid_t last_pid;
+    int alive;           // processes not reaped yet
+    string cmd;
+    JobState state = JOB_RUNNING;
+    int status = 0;      // shell status of the last process
+    bool foreground = false;
+    bool notify = false; // state change not reported yet
+    struct timespec started, ended;
+    string cgroup;       // own cgroup under `limit`, removed with the job
+    bool demoted = false; // running under $BG_SCHED
+    vector<shared_ptr<HopStats>> meters;
+};
+
+static map<int, Job> jobs;
+// The process the table belongs to. A forked pipeline builtin (`jobs | cat`)
+// only reads the copy it inherited: it can't wait for the shell's children.
+static pid_t owner = getpid();
+static long peak_rss_kb = 0; // largest ru_maxrss reaped since jobs_peak_rss()
+
+static int status_code(int st) {
+    if (WIFEXITED(st)) return WEXITSTATUS(st);
+    if (WIFSIGNALED(st)) return 128 + WTERMSIG(st);
+    if (WIFSTOPPED(st)) return 128 + WSTOPSIG(st);
+    return 1;
+}
+
+int job_add(pid_t pgid, pid_t last_pid, int nprocs, const string& cmd) {
+    int id = jobs.empty() ? 1 : jobs.rbegin()->first + 1;
+    Job& j = jobs[id];
+    j.pgid = pgid;
+    j.last_pid = last_pid;
+    j.alive = nprocs;
+    j.cmd = cmd;
+    clock_gettime(CLOCK_MONOTONIC, &j.started);
+    return id;
+}
+
+void job_set_cgroup(int id, const string& dir) {
+    auto it = jobs.find(id);
+    if (it != jobs.end()) it->second.cgroup = dir;
+}
+
+void job_set_meters(int id, const vector<shared_ptr<HopStats>>& meters) {
+    auto it = jobs.find(id);
+    if (it == jobs.end()) return;
+    it->second.meters = meters;
+    // A background job's Done notice waits for its relays (jobs_notify)
+    if (reactor_active() && meter_done_fd() >= 0) reactor_add_fd(meter_done_fd(), [] {
+        meter_done_drain();
+        jobs_notify();
+    });
+}
+
+static bool meters_done(const Job& j) {
+    for (auto& m : j.meters)
+        if (!m->done.load(memory_order_acquire)) return false;
+    return true;
+}
+
+// A relay finishes right after the last process of its hop, so the final
+// counts are worth a short wait: up to 200ms on meter_done_fd().
+static void wait_meters(const Job& j) {
+    struct timespec t0, now;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (!meters_done(j)) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long left = 200 - ((now.tv_sec - t0.tv_sec) * 1000 + (now.tv_nsec - t0.tv_nsec) / 1000000);
+        if (left <= 0) break;
+        struct pollfd p = {meter_done_fd(), POLLIN, 0};
+        if (poll(&p, 1, (int)left) > 0) meter_done_drain();
+    }
+}
+
+// Fan-out branches are left to `jobs -v` and the Done notice (all).
+static string meter_lines(const Job& j, bool all) {
+    string out;
+    for (auto& m : j.meters) if (all || m->summary) out += "    " + meter_report(*m) + "\n";
+    return out;
+}
+
+void job_set_demoted(int id) {
+    auto it = jobs.find(id);
+    if (it != jobs.end()) it->second.demoted = true;
+}
+
+static map<int, Job>::iterator job_drop(map<int, Job>::iterator it) {
+    cgroup_release(it->second.cgroup);
+    return jobs.erase(it);
+}
+
+long jobs_peak_rss() {
+    long kb = peak_rss_kb;
+    peak_rss_kb = 0;
+    return kb;
+}
+
+// Apply one wait4() result to its job.
+static void job_update(Job& j, pid_t pid, int st, const struct rusage& ru) {
+    if (!WIFSTOPPED(st) && !WIFCONTINUED(st) && ru.ru_maxrss > peak_rss_kb) peak_rss_kb = ru.ru_maxrss;
+    if (WIFSTOPPED(st)) {
+        j.state = JOB_STOPPED;
+        j.notify = true;
+    } else if (WIFCONTINUED(st)) {
+        j.state = JOB_RUNNING;
+    } else {
+        if (pid == j.last_pid) j.status = status_code(st); // pipeline status is the last stage's
+        if (--j.alive <= 0) {
+            j.state = JOB_DONE;
+            j.notify = true;
+            clock_gettime(CLOCK_MONOTONIC, &j.ended);
+        }
+    }
+}
+
+void jobs_own() {
+    jobs.clear(); // the parent's jobs, cgroups and relays stay the parent's
+    owner = getpid();
+}
+
+void jobs_reap() {
+    if (getpid() != owner) return;
+    for (auto& kv : jobs) {
+        Job& j = kv.second;
+        if (j.foreground || j.state == JOB_DONE) continue;
+        int st;
+        struct rusage ru;
+        pid_t w;
+        while ((w = wait4(-j.pgid, &st, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0) job_update(j, w, st, ru);
+        if (w < 0 && errno == ECHILD && j.state != JOB_DONE) {
+            j.alive = 0;
+            j.state = JOB_DONE;
+            j.notify = true;
+            clock_gettime(CLOCK_MONOTONIC, &j.ended);
+        }
+    }
+}
+
+void jobs_notify() {
+    if (getpid() != owner) return;
+    string out;
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        Job& j = it->second;
+        if (!j.notify) { ++it; continue; }
+        if (j.state == JOB_DONE && !meters_done(j)) {
+            // Under the reactor the relays wake us when they finish
+            if (reactor_active()) { ++it; continue; }
+            wait_meters(j);
+        }
+        j.notify = false;
+        char line[128];
+        if (j.state == JOB_DONE) {
+            double secs = (j.ended.tv_sec - j.started.tv_sec) + (j.ended.tv_nsec - j.started.tv_nsec) / 1e9;
+            snprintf(line, sizeof(line), "[%d] Done    ", it->first);
+            out += line + j.cmd;
+            snprintf(line, sizeof(line), " (status %d, %.2fs)\n", j.status, secs);
+            out += line;
+            if (!j.meters.empty()) out += meter_lines(j, true);
+            it = job_drop(it);
+            continue;
+        }
+        snprintf(line, sizeof(line), "[%d] Stopped ", it->first);
+        out += line + j.cmd + "\n";
+        ++it;
+    }
+    if (!out.empty()) input_print_above(out);
+}
+
+int job_wait_fg(int id) {
+    auto it = jobs.find(id);
+    if (it == jobs.end()) return 1;
+    Job& j = it->second;
+    j.foreground = true;
+    FG_PGID = j.pgid;
+    while (j.state != JOB_DONE) {
+        // Under the reactor: never block in waitpid, so Ctrl+C/Ctrl+Z are
+        // still forwarded; SIGCHLD wakes the loop when a stage changes state.
+        int st;
+        struct rusage ru;
+        pid_t w = wait4(-j.pgid, &st, WUNTRACED | (reactor_active() ? WNOHANG : 0), &ru);
+        if (w == 0) { reactor_run_once(-1); continue; }
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            j.state = JOB_DONE; // ECHILD: nothing left to wait for
+            break;
+        }
+        job_update(j, w, st, ru);
+        if (WIFSTOPPED(st)) {
+            j.status = status_code(st);
+            break;
+        }
+    }
+    FG_PGID = 0;
+    j.foreground = false;
+    int result = j.status;
+    if (j.state == JOB_STOPPED) {
+        j.notify = false;
+        cout << "\n[" << id << "] Stopped " << j.cmd << "\n";
+        return result;
+    }
+    if (j.meters.empty()) {
+        job_drop(it);
+        return result;
+    }
+    wait_meters(j);
+    cerr << meter_lines(j, false);
+    job_drop(it);
+    jobs_notify(); // the wait may have taken a background job's wakeup
+    return result;
+}
+
+// %n, n, or the newest job when omitted.
+static int pick_job(char** args, const char* who) {
+    if (jobs.empty()) {
+        cerr << who << ": no current job\n";
+        return 0;
+    }
+    if (!args[1]) return jobs.rbegin()->first;
+    const char* a = args[1][0] == '%' ? args[1] + 1 : args[1];
+    int id = atoi(a);
+    if (!jobs.count(id)) {
+        cerr << who << ": " << args[1] << ": no such job\n";
+        return 0;
+    }
+    return id;
+}
+
+// jobs [-v]: -v adds the pgid and, for a job under `limit`, its cgroup usage.
+int builtin_jobs(char** args) {
+    bool verbose = args[1] && strcmp(args[1], "-v") == 0;
+    jobs_reap();
+    for (auto& kv : jobs) {
+        const Job& j = kv.second;
+        const char* state = j.state == JOB_STOPPED ? "Stopped" : j.state == JOB_DONE ? "Done   " : "Running";
+        cout << "[" << kv.first << "] " << state << " " << j.cmd << "\n";
+        if (!verbose) continue;
+        errno = 0;
+        int nv = getpriority(PRIO_PROCESS, (id_t)j.pgid);
+        cout << "    pgid " << j.pgid;
+        if (errno == 0) cout << "  nice " << nv;
+        if (!j.cgroup.empty()) cout << "  " << cgroup_stats(j.cgroup) << "\n    cgroup " << j.cgroup;
+        cout << "\n";
+        for (auto& m : j.meters) cout << "    " << meter_report(*m) << "\n";
+    }
+    return 0;
+}
+
+int builtin_fg(char** args) {
+    int id = pick_job(args, "fg");
+    if (!id) return 1;
+    Job& j = jobs[id];
+    cout << j.cmd << "\n";
+    cout.flush();
+    if (j.demoted && !bgsched_promote(j.pgid))
+        cerr << "fg: %" << id << ": priority not restored (needs CAP_SYS_NICE or a higher RLIMIT_NICE)\n";
+    j.demoted = false;
+    j.state = JOB_RUNNING;
+    kill(-j.pgid, SIGCONT);
+    return job_wait_fg(id);
+}
+
+int builtin_bg(char** args) {
+    int id = pick_job(args, "bg");
+    if (!id) return 1;
+    Job& j = jobs[id];
+    if (!j.demoted) j.demoted = bgsched_demote(j.pgid);
+    j.state = JOB_RUNNING;
+    kill(-j.pgid, SIGCONT);
+    cout << "[" << id << "] " << j.cmd << " &\n";
+    return 0;
+}
+
+// renice [-n] N %job|pid...: the job's processes all get nice value N
+// (absolute, like setpriority). fg leaves an explicit value alone.
+int builtin_renice(char** args) {
+    int i = 1;
+    if (args[i] && strcmp(args[i], "-n") == 0) i++;
+    char* end = nullptr;
+    long nv = args[i] ? strtol(args[i], &end, 10) : 0;
+    if (!args[i] || !args[i + 1] || end == args[i] || *end || nv < -20 || nv > 19) {
+        cerr << "usage: renice [-n] N %job|pid...\n";
+        return 2;
+    }
+    int rc = 0;
+    for (++i; args[i]; i++) {
+        if (args[i][0] == '%') {
+            char* pick[] = {args[0], args[i], nullptr};
+            int id = pick_job(pick, "renice");
+            if (!id) { rc = 1; continue; }
+            Job& j = jobs[id];
+            if (setpriority(PRIO_PGRP, (id_t)j.pgid, (int)nv) < 0) {
+                cerr << "renice: " << args[i] << ": " << strerror(errno) << "\n";
+                rc = 1;
+                continue;
+            }
+            j.demoted = false;
+            continue;
+        }
+        long pid = strtol(args[i], &end, 10);
+        if (*end || pid <= 0 || setpriority(PRIO_PROCESS, (id_t)pid, (int)nv) < 0) {
+            cerr << "renice: " << args[i] << ": " << (*end || pid <= 0 ? "not a job or pid" : strerror(errno)) << "\n";
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+// limit [options] %n: put a running job under (new) limits. The
+// `limit [options] cmd...` prefix form is taken apart in exec.cpp.
+int builtin_limit(char** args) {
+    CgLimits lim;
+    int k = cgroup_parse_limits(args, lim, "limit");
+    if (k < 0) return 2;
+    if (!args[k] || args[k][0] != '%' || args[k + 1]) {
+        cerr << "usage: limit [--cpu-weight N] [--cpu-max PCT] [--mem-max SIZE] [--pids-max N] (cmd... | %job)\n";
+        return 2;
+    }
+    char* pick[] = {args[0], args[k], nullptr};
+    int id = pick_job(pick, "limit");
+    if (!id) return 1;
+    Job& j = jobs[id];
+    if (j.cgroup.empty()) {
+        string dir = cgroup_create(lim, "limit");
+        if (dir.empty()) return 1;
+        if (!cgroup_adopt(dir, j.pgid)) {
+            cgroup_release(dir);
+            cerr << "limit: %" << id << ": no processes left to move\n";
+            return 1;
+        }
+        j.cgroup = dir;
+        return 0;
+    }
+    return cgroup_apply(j.cgroup, lim, "limit") ? 0 : 1;
+}
@@ -5,18 +5,54 @@
 #include "signals.h"
 #include "arrow.h"
 #include "common.h"
+#include "vars.h"
+#include "server.h"
+#include "zygote.h"
+#include "script.h"
+#include "scriptcache.h"
+#include "warmup.h"
+#include "reactor.h"
+#include "jobs.h"
+#include "interp.h"
+#include "history.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <unistd.h>
 #include <limits.h>
 #include <iostream>
 using namespace std;
+extern char** environ;
+
+int main(int argc, char* argv[]){
+    // --zygote N: fork the launcher first, while the process is still small
+    int zygote_workers = 0;
+    const char* server_path = nullptr;
+    const char* script_path = nullptr; // mysh [options] file
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--zygote") == 0 && i + 1 < argc) zygote_workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) server_path = argv[++i];
+        else if (strcmp(argv[i], "--no-cache") == 0) setenv("MYSH_SCRIPT_CACHE", "off", 1);
+        else if (strcmp(argv[i], "--cache-stats") == 0) return script_cache_report();
+        else if (argv[i][0] != '-' && !script_path) script_path = argv[i];
+    }
+    if (zygote_workers > 0 && !server_path && !zygote_start(zygote_workers))
+        cerr << "mysh: zygote mode unavailable, using fork\n";
 
-int main(){
     char cwd[PATH_MAX]; 
     getcwd(cwd,sizeof(cwd)); 
     SHELL_HOME = cwd;
+    vars_init(environ);
     install_shell_signal_handlers();
+    if (script_path)
+        return run_script_file(script_path); // no history or prompt for scripts
     load_history();
+    if (server_path)
+        return run_server(server_path, zygote_workers);
+    warmup_start(); // PATH index builds while the first prompt is up
+    if (isatty(STDIN_FILENO) && reactor_init()) install_reactor_signal_handlers();
     while (true){
+        if (!reactor_active()) { jobs_reap(); jobs_notify(); } // otherwise reported on SIGCHLD
         string prompt = get_prompt(false); // get current prompt string from prompt.cpp
         string line = read_input_line(); // read input line with arrow key support from arrow.cpp
         if (line == "__MYSH_EOF__"){ cout << "Process Terminated\n"; break; } //handles Cntl+D
@@ -28,12 +64,34 @@ int main(){
         if (t=="exitall"){ 
             cout<<"Exitall: terminating\n"; break; 
         }
-        auto cmds = parse_line_strtok(line);
-        for (auto &p: cmds)
-        { 
-            run_parsed(p); //run each parsed command from exec.cpp
-            free_parsed(p); 
+        // Keep reading while an if/while/for, a trailing && || | or a
+        // here-doc is still open; a pasted block arrives as one text
+        Node root;
+        string err;
+        ParseStatus ps;
+        SHELL_INTERRUPTED = 0;
+        while ((ps = parse_script(line, root, err, false)) == PARSE_MORE) {
+            string more;
+            if (!read_continuation_line(more)) {
+                if (SHELL_INTERRUPTED) break; // Ctrl+C drops the command
+                ps = parse_script(line, root, err, true);
+                break;
+            }
+            line += "\n" + more;
         }
+        if (ps == PARSE_MORE) continue;
+        if (ps == PARSE_ERROR) { cerr << "mysh: " << err << "\n"; continue; }
+        // Timing, status, cwd and peak RSS go to the history sidecar
+        string dir = getcwd(cwd, sizeof(cwd)) ? cwd : "";
+        time_t started = time(nullptr);
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        jobs_peak_rss(); // drop what earlier background jobs left
+        int status = run_tree(root); // tree-walking interpreter, interp.cpp
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        history_record(line, dir, started, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, status, jobs_peak_rss());
+        free_tree(root);
+        if (exit_requested()) break;
     }
     save_history();
     return 0;
@@ -1,8 +1,10 @@
 
 #include "parser.h"
 #include "common.h"
+#include "vars.h"
 #include <cstring>
 #include <cstdlib>
+#include <initializer_list>
 #include <vector>
 
 static void push_token(std::vector<char*>& argv, const char* tok){
@@ -14,55 +16,403 @@ static void push_token(std::vector<char*>& argv, const char* tok){
 }
 static void null_terminate(std::vector<char*>& argv){ argv.push_back(nullptr); }
 
-static CmdStage parse_stage(char* stage_cstr){
+// A quoted here-doc delimiter turns off $VAR expansion of the body
+static std::string unquote_delim(const std::string& d, bool* quoted){
+    if (d.size() >= 2 && (d[0]=='\'' || d[0]=='"') && d.back()==d[0]){
+        if (quoted) *quoted = true;
+        return d.substr(1, d.size()-2);
+    }
+    if (quoted) *quoted = false;
+    return d;
+}
+
+// ---------- Lexer ----------
+// Words are split on blanks; ; & && || | |> |{ and newline are operators wherever
+// they appear outside '...' and "..." (a quote with no closing one is an
+// ordinary character). Quotes stay in the word until expansion. A word starting with # begins a comment. Here-doc bodies are
+// taken from the lines after the next newline and kept on the << token.
+// <(cmd) and >(cmd) at the start of a word run to the matching ), blanks,
+// operators and newlines included.
+enum TokKind { T_WORD, T_SEMI, T_AMP, T_AND, T_OR, T_PIPE, T_FANOUT, T_NL, T_EOF };
+struct Tok {
+    TokKind kind;
+    std::string text;
+    std::string body;
+};
+
+static std::vector<Tok> lex(const std::string& s, bool& open_heredoc, bool& open_subst){
+    std::vector<Tok> toks;
+    std::vector<std::pair<size_t, std::string>> pending; // << token, delimiter
+    bool want_delim = false;                             // "<<" then a separate word
+    size_t pos = 0, n = s.size();
+    open_heredoc = open_subst = false;
+    while (pos < n){
+        char c = s[pos];
+        if (c==' ' || c=='\t' || c=='\r'){ ++pos; continue; }
+        if (c=='#'){
+            while (pos < n && s[pos] != '\n') ++pos;
+            continue;
+        }
+        if (c=='\n'){
+            toks.push_back({T_NL, "\n", ""});
+            ++pos;
+            for (auto& h : pending){
+                std::string& body = toks[h.first].body;
+                while (true){
+                    if (pos >= n){ open_heredoc = true; break; }
+                    size_t nl = s.find('\n', pos);
+                    if (nl == std::string::npos) nl = n;
+                    std::string line = s.substr(pos, nl - pos);
+                    pos = nl < n ? nl + 1 : n;
+                    if (line == h.second) break;
+                    body += line;
+                    body += '\n';
+                }
+            }
+            pending.clear();
+            want_delim = false;
+            continue;
+        }
+        if (c==';'){ toks.push_back({T_SEMI, ";", ""}); ++pos; continue; }
+        if (c=='|' && pos + 1 < n && s[pos+1] == '>'){ toks.push_back({T_PIPE, "|>", ""}); pos += 2; continue; }
+        if (c=='|' && pos + 1 < n && s[pos+1] == '{'){ toks.push_back({T_FANOUT, "|{", ""}); pos += 2; continue; }
+        if (c=='&' || c=='|'){
+            bool twice = pos + 1 < n && s[pos+1] == c;
+            if (c=='&') toks.push_back(twice ? Tok{T_AND, "&&", ""} : Tok{T_AMP, "&", ""});
+            else toks.push_back(twice ? Tok{T_OR, "||", ""} : Tok{T_PIPE, "|", ""});
+            pos += twice ? 2 : 1;
+            continue;
+        }
+        size_t start = pos;
+        if ((c=='<' || c=='>') && pos + 1 < n && s[pos+1] == '('){
+            int depth = 0;
+            for (; pos < n; ++pos){
+                if (s[pos] == '(') ++depth;
+                else if (s[pos] == ')' && --depth == 0) break;
+            }
+            if (pos < n) ++pos;
+            else open_subst = true;
+        }
+        while (pos < n && !strchr(" \t\r\n;&|", s[pos])){
+            if (s.compare(pos, 3, "$((") == 0){ // $(( a | b )) is one word
+                size_t e = arith_end(s, pos + 3);
+                if (e != std::string::npos){ pos = e; continue; }
+            }
+            if (s[pos] == '\'' || s[pos] == '"'){
+                size_t close = s.find(s[pos], pos + 1);
+                if (close != std::string::npos){ pos = close + 1; continue; }
+            }
+            ++pos;
+        }
+        std::string w = s.substr(start, pos - start);
+        if (want_delim){
+            pending.push_back({toks.size() - 1, unquote_delim(w, nullptr)});
+            want_delim = false;
+        } else if (w.compare(0, 2, "<<") == 0 && w.compare(0, 3, "<<<") != 0){
+            if (w.size() > 2) pending.push_back({toks.size(), unquote_delim(w.substr(2), nullptr)});
+            else want_delim = true;
+        }
+        toks.push_back({T_WORD, w, ""});
+    }
+    if (!pending.empty()) open_heredoc = true;
+    toks.push_back({T_EOF, "", ""});
+    return toks;
+}
+
+// ---------- Stages ----------
+static CmdStage make_stage(const std::vector<const Tok*>& words){
     CmdStage st;
-    const char* delims = " \t\r\n";
-    char* saveptr = nullptr;
-    char* tok = strtok_r(stage_cstr, delims, &saveptr);
-    while (tok){
-        if (strcmp(tok,"<")==0){
-            tok = strtok_r(nullptr, delims, &saveptr);
-            if (tok) st.infile = tok;
-        } else if (strcmp(tok,">>")==0){
-            tok = strtok_r(nullptr, delims, &saveptr);
-            if (tok){ st.outfile = tok; st.append = true; }
-        } else if (strcmp(tok,">")==0){
-            tok = strtok_r(nullptr, delims, &saveptr);
-            if (tok){ st.outfile = tok; st.append = false; }
+    for (size_t k = 0; k < words.size(); ++k){
+        const std::string& tok = words[k]->text;
+        const std::string* next = k + 1 < words.size() ? &words[k+1]->text : nullptr;
+        if (tok.compare(0, 3, "<<<") == 0){
+            std::string w = tok.size() > 3 ? tok.substr(3) : (next ? *next : "");
+            if (tok.size() == 3 && next) ++k;
+            if (tok.size() > 3 || next){ st.here_body = w + "\n"; st.has_here = true; st.here_delim.clear(); }
+        } else if (tok.compare(0, 2, "<<") == 0){
+            const Tok* op = words[k];
+            std::string d = tok.size() > 2 ? tok.substr(2) : (next ? *next : "");
+            if (tok.size() == 2 && next) ++k;
+            if (d.empty()) continue;
+            bool quoted;
+            st.here_delim = unquote_delim(d, &quoted);
+            st.here_expand = !quoted;
+            st.here_body = op->body;
+            st.has_here = true;
+        } else if (tok == "<"){
+            if (next){ st.infile = *next; ++k; }
+        } else if (tok == ">>"){
+            if (next){ st.outfile = *next; st.append = true; ++k; }
+        } else if (tok == ">"){
+            if (next){ st.outfile = *next; st.append = false; ++k; }
+        } else if (st.argv.empty() && is_assignment(tok.c_str())) {
+            st.assigns.push_back(tok);
         } else {
-            push_token(st.argv, tok);
+            push_token(st.argv, tok.c_str());
         }
-        tok = strtok_r(nullptr, delims, &saveptr);
     }
     null_terminate(st.argv);
     return st;
 }
 
-std::vector<Parsed> parse_line_strtok(const std::string& line){
-    std::vector<Parsed> out;
-    auto parts = split_simple(line, ';');
-    for (auto &part : parts){
-        std::string s = trim(part);
-        if (s.empty()) continue;
-        Parsed P;
-        // check background
-        size_t i = s.find_last_not_of(" \t\r\n");
-        if (i != std::string::npos && s[i]=='&'){
-            P.background = true;
-            s = trim(s.substr(0,i));
-        }
-        auto stages = split_simple(s,'|');
-        for (auto &stg : stages){
-            std::string t = trim(stg);
-            if (t.empty()) continue;
-            std::vector<char> buf(t.begin(), t.end());
-            buf.push_back('\0');
-            CmdStage cs = parse_stage(buf.data());
-            P.stages.push_back(std::move(cs));
-        }
-        if (!P.stages.empty()) out.push_back(std::move(P));
-    }
-    return out;
+// ---------- Grammar ----------
+//   list     := and_or ((; | & | newline) and_or)*
+//   and_or   := pipeline ((&& | ||) newline* pipeline)*
+//   pipeline := [!] (if | while | until | for | stages [|{ stages ((; | newline) stages)* }])
+//   stages   := stage ((| or |>) newline* stage)*
+// Reserved words only count where a command starts. Partial nodes are
+// attached to the tree as they are built, so free_tree() releases
+// everything after a failed parse.
+struct Parser {
+    std::vector<Tok> toks;
+    size_t i = 0;
+    bool more = false;  // input ended where more was expected
+    std::string err;
+    int in_fanout = 0;  // inside |{ }, where } ends a consumer
+    int depth = 0;      // nested list/and-or/pipeline levels, >= node depth
+
+    struct Nest {
+        int& d;
+        ~Nest(){ --d; }
+    };
+    bool too_deep(){
+        err = "syntax error: commands nested too deeply";
+        return false;
+    }
+
+    const Tok& peek() const { return toks[i]; }
+    bool at_word(const char* w) const { return toks[i].kind == T_WORD && toks[i].text == w; }
+    void skip_newlines(){ while (toks[i].kind == T_NL) ++i; }
+
+    bool unexpected(){
+        if (toks[i].kind == T_EOF){ more = true; return false; }
+        err = "syntax error near unexpected token `" + (toks[i].kind == T_NL ? std::string("newline") : toks[i].text) + "'";
+        return false;
+    }
+    bool expect(const char* w){
+        if (!at_word(w)) return unexpected();
+        ++i;
+        return true;
+    }
+
+    static bool is_reserved(const std::string& w){
+        static const char* const words[] = {"if","then","elif","else","fi","while","until","do","done","for","!"};
+        for (const char* r : words) if (w == r) return true;
+        return false;
+    }
+
+    bool parse_list(Node& list, std::initializer_list<const char*> stops){
+        Nest nest{depth};
+        if (++depth > NODE_DEPTH_MAX) return too_deep();
+        list.kind = N_LIST;
+        while (true){
+            while (peek().kind == T_NL || peek().kind == T_SEMI) ++i;
+            const Tok& t = peek();
+            if (t.kind == T_EOF){
+                if (stops.size() == 0) return true;
+                more = true;
+                return false;
+            }
+            if (t.kind == T_WORD){
+                for (const char* s : stops) if (t.text == s) return true;
+            }
+            if (t.kind != T_WORD) return unexpected();
+            list.kids.emplace_back();
+            Node& item = list.kids.back();
+            if (!parse_and_or(item)) return false;
+            switch (peek().kind){
+                case T_SEMI: case T_NL: ++i; break;
+                case T_AMP:
+                    item.background = true;
+                    if (item.kind == N_PIPELINE) item.cmd.background = true;
+                    ++i;
+                    break;
+                case T_EOF: break;
+                default: return unexpected();
+            }
+        }
+    }
+
+    // One flat node per chain, however long: a && b || c runs left to right.
+    bool parse_and_or(Node& out){
+        Nest nest{depth};
+        if (++depth > NODE_DEPTH_MAX) return too_deep();
+        if (!parse_pipeline(out)) return false;
+        if (peek().kind != T_AND && peek().kind != T_OR) return true;
+        Node n;
+        n.kind = N_ANDOR;
+        n.kids.push_back(std::move(out));
+        out = std::move(n);
+        while (peek().kind == T_AND || peek().kind == T_OR){
+            out.ops += peek().kind == T_AND ? '&' : '|';
+            ++i;
+            out.kids.emplace_back();
+            skip_newlines();
+            if (!parse_pipeline(out.kids.back())) return false;
+        }
+        return true;
+    }
+
+    bool parse_pipeline(Node& out){
+        Nest nest{depth};
+        if (++depth > NODE_DEPTH_MAX) return too_deep();
+        if (at_word("!")){
+            ++i;
+            out.kind = N_NOT;
+            out.kids.emplace_back();
+            return parse_pipeline(out.kids[0]);
+        }
+        if (at_word("if")) return parse_if(out);
+        if (at_word("while")) return parse_loop(out, N_WHILE);
+        if (at_word("until")) return parse_loop(out, N_UNTIL);
+        if (at_word("for")) return parse_for(out);
+        if (peek().kind == T_WORD && is_reserved(peek().text)) return unexpected();
+
+        out.kind = N_PIPELINE;
+        std::vector<const Tok*> words;
+        while (true){
+            if (in_fanout && at_word("}")) break;
+            if (peek().kind == T_WORD){ words.push_back(&peek()); ++i; continue; }
+            if (peek().kind != T_PIPE) break;
+            if (words.empty()) return unexpected();
+            out.cmd.stages.push_back(make_stage(words));
+            out.cmd.stages.back().meter = peek().text == "|>";
+            words.clear();
+            ++i;
+            skip_newlines();
+            if (peek().kind != T_WORD || is_reserved(peek().text)) return unexpected(); // no compound stages
+        }
+        if (words.empty()) return unexpected();
+        out.cmd.stages.push_back(make_stage(words));
+        if (peek().kind == T_FANOUT) return parse_fanout(out.cmd);
+        return true;
+    }
+
+    // |{ consumer ; consumer ... }: simple pipelines, one per branch
+    bool parse_fanout(Parsed& cmd){
+        if (in_fanout) return unexpected(); // no nested fan-out
+        ++i;
+        ++in_fanout;
+        while (true){
+            while (peek().kind == T_NL || peek().kind == T_SEMI) ++i;
+            if (at_word("}")) break;
+            if (peek().kind != T_WORD) return unexpected();
+            cmd.fanout.emplace_back();
+            Node c;
+            bool ok = parse_pipeline(c);
+            if (ok && c.kind != N_PIPELINE){
+                err = "syntax error: a |{ } branch must be a simple pipeline";
+                ok = false;
+            }
+            if (ok) std::swap(cmd.fanout.back(), c.cmd);
+            free_tree(c);
+            if (!ok) return false;
+            if (peek().kind != T_SEMI && peek().kind != T_NL && !at_word("}")) return unexpected();
+        }
+        --in_fanout;
+        if (cmd.fanout.empty()) return unexpected();
+        ++i;
+        return true;
+    }
+
+    // A condition or body must hold at least one command.
+    bool parse_body(Node& out, std::initializer_list<const char*> stops){
+        out.kids.emplace_back();
+        Node& body = out.kids.back();
+        if (!parse_list(body, stops)) return false;
+        if (body.kids.empty()) return unexpected();
+        return true;
+    }
+
+    bool parse_if(Node& out){
+        out.kind = N_IF;
+        ++i;
+        if (!parse_body(out, {"then"}) || !expect("then")) return false;
+        if (!parse_body(out, {"elif", "else", "fi"})) return false;
+        while (at_word("elif")){
+            ++i;
+            if (!parse_body(out, {"then"}) || !expect("then")) return false;
+            if (!parse_body(out, {"elif", "else", "fi"})) return false;
+        }
+        if (at_word("else")){
+            ++i;
+            out.has_else = true;
+            if (!parse_body(out, {"fi"})) return false;
+        }
+        return expect("fi");
+    }
+
+    bool parse_loop(Node& out, NodeKind kind){
+        out.kind = kind;
+        ++i;
+        if (!parse_body(out, {"do"}) || !expect("do")) return false;
+        if (!parse_body(out, {"done"})) return false;
+        return expect("done");
+    }
+
+    // for NAME [in word...] (; | newline) do list done
+    bool parse_for(Node& out){
+        out.kind = N_FOR;
+        ++i;
+        const Tok& name = peek();
+        if (name.kind != T_WORD || !is_assignment((name.text + "=").c_str())) return unexpected();
+        out.var = name.text;
+        ++i;
+        skip_newlines();
+        if (at_word("in")){
+            ++i;
+            while (peek().kind == T_WORD){ out.words.push_back(peek().text); ++i; }
+            if (peek().kind != T_SEMI && peek().kind != T_NL) return unexpected();
+            ++i;
+        } else if (peek().kind == T_SEMI){
+            ++i;
+        }
+        skip_newlines();
+        if (!expect("do")) return false;
+        if (!parse_body(out, {"done"})) return false;
+        return expect("done");
+    }
+};
+
+ParseStatus parse_script(const std::string& text, Node& out, std::string& err, bool at_eof){
+    bool open_heredoc, open_subst;
+    Parser ps;
+    ps.toks = lex(text, open_heredoc, open_subst);
+    out = Node();
+    if (open_subst){
+        if (!at_eof) return PARSE_MORE;
+        err = "syntax error: unexpected end of file while looking for matching `)'";
+        return PARSE_ERROR;
+    }
+    bool ok = ps.parse_list(out, {});
+    if (ok && !(open_heredoc && !at_eof)) return PARSE_OK;
+    free_tree(out);
+    if (ok || ps.more){
+        if (!at_eof) return PARSE_MORE;
+        err = "syntax error: unexpected end of file";
+        return PARSE_ERROR;
+    }
+    err = ps.err;
+    return PARSE_ERROR;
+}
+
+char procsub_kind(const char* w){
+    size_t len = w ? strlen(w) : 0;
+    if (len < 3 || (w[0] != '<' && w[0] != '>') || w[1] != '(' || w[len-1] != ')') return 0;
+    return w[0];
+}
+
+static void dup_argv(Parsed& c){
+    for (auto &st : c.stages)
+        for (char*& a : st.argv)
+            if (a) a = strdup(a);
+    for (auto &f : c.fanout) dup_argv(f);
+}
+
+Parsed copy_parsed(const Parsed& p){
+    Parsed c = p;
+    dup_argv(c);
+    return c;
 }
 
 void free_parsed(Parsed& p){
@@ -71,6 +421,15 @@ void free_parsed(Parsed& p){
             if (a) free(a);
         }
         st.argv.clear();
+        st.assigns.clear();
     }
     p.stages.clear();
+    for (auto &f : p.fanout) free_parsed(f);
+    p.fanout.clear();
+}
+
+void free_tree(Node& n){
+    free_parsed(n.cmd);
+    for (auto& k : n.kids) free_tree(k);
+    n.kids.clear();
 }
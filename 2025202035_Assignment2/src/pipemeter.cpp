@@ -0,0 +1,138 @@
+#include "pipemeter.h"
+#include "common.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <thread>
+#include <poll.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+// One bit per fd; atomics rather than a lock, since a child forked while a
+// relay thread held a lock could never take it.
+static const int TRACK_MAX = 4096;
+static atomic<uint64_t> tracked[TRACK_MAX / 64];
+
+void relay_track(int fd) {
+    if (fd >= 0 && fd < TRACK_MAX) tracked[fd / 64] |= 1ull << (fd % 64);
+}
+
+void relay_close(int fd) {
+    if (fd >= 0 && fd < TRACK_MAX) tracked[fd / 64] &= ~(1ull << (fd % 64));
+    close(fd);
+}
+
+void relay_close_inherited() {
+    for (int w = 0; w < TRACK_MAX / 64; w++) {
+        uint64_t bits = tracked[w].exchange(0);
+        for (int b = 0; bits; b++, bits >>= 1)
+            if (bits & 1) close(w * 64 + b);
+    }
+}
+
+// Relays report completion here, so the shell waits on an fd instead of
+// polling the done flags.
+static int done_pipe[2] = {-1, -1};
+
+int meter_done_fd() { return done_pipe[0]; }
+
+void meter_finish(HopStats& s) {
+    clock_gettime(CLOCK_MONOTONIC, &s.end);
+    s.done.store(true, memory_order_release);
+    (void)!write(done_pipe[1], "x", 1); // a full pipe already has a wakeup queued
+}
+
+void meter_done_drain() {
+    char buf[64];
+    while (done_pipe[0] >= 0 && read(done_pipe[0], buf, sizeof(buf)) > 0) {}
+}
+
+static uint64_t now_ns(struct timespec* ts) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+// Blocks until the hop can move again; a full output pipe counts as a
+// stall. False once the consumer is gone.
+static bool wait_ready(HopStats& s, int in, int out) {
+    struct pollfd po = {out, POLLOUT, 0};
+    if (poll(&po, 1, 0) == 0) {
+        struct timespec ts;
+        uint64_t t0 = now_ns(&ts);
+        while (poll(&po, 1, -1) < 0 && errno == EINTR) {}
+        s.stalls++;
+        s.stall_ns += now_ns(&ts) - t0;
+    }
+    if (po.revents & (POLLERR | POLLNVAL)) return false;
+    struct pollfd pi = {in, POLLIN, 0};
+    while (poll(&pi, 1, -1) < 0 && errno == EINTR) {}
+    return true;
+}
+
+static void relay(shared_ptr<HopStats> s, int in, int out) {
+#ifdef __linux__
+    for (;;) {
+        ssize_t n = splice(in, nullptr, out, nullptr, 1 << 20, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) { s->bytes += (uint64_t)n; continue; }
+        if (n == 0) break; // producer closed
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN || !wait_ready(*s, in, out)) break;
+    }
+#else
+    static thread_local char buf[65536];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) goto finished;
+            off += w;
+        }
+        s->bytes += (uint64_t)n;
+    }
+finished:
+#endif
+    relay_close(in);
+    relay_close(out);
+    meter_finish(*s);
+}
+
+void relay_spawn(function<void()> fn) {
+    if (done_pipe[0] < 0 && pipe(done_pipe) == 0) {
+        for (int fd : done_pipe) {
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    thread(move(fn)).detach();
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+shared_ptr<HopStats> meter_start(int in_fd, int out_fd, const string& label) {
+    auto s = make_shared<HopStats>();
+    s->label = label;
+    clock_gettime(CLOCK_MONOTONIC, &s->start);
+    relay_track(in_fd);
+    relay_track(out_fd);
+    relay_spawn([s, in_fd, out_fd] { relay(s, in_fd, out_fd); });
+    return s;
+}
+
+string meter_report(const HopStats& s) {
+    struct timespec end;
+    if (s.done.load(memory_order_acquire)) end = s.end; // written before done
+    else clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (end.tv_sec - s.start.tv_sec) + (end.tv_nsec - s.start.tv_nsec) / 1e9;
+    double bytes = (double)s.bytes.load();
+    char buf[160];
+    snprintf(buf, sizeof(buf), ": %s in %.2fs (%s/s), %llu stalls (%.2fs)", human_bytes(bytes).c_str(), secs,
+             human_bytes(secs > 0 ? bytes / secs : 0).c_str(), (unsigned long long)s.stalls.load(), s.stall_ns.load() / 1e9);
+    string out = s.label + buf;
+    if (s.dropped) out += ", dropped " + human_bytes((double)s.dropped.load());
+    return out;
+}
@@ -0,0 +1,163 @@
+#include "reactor.h"
+#include <csignal>
+#include <cerrno>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#else
+#include <poll.h>
+#endif
+using namespace std;
+
+static const int reactor_signals[] = {SIGCHLD, SIGINT, SIGTSTP, SIGWINCH};
+
+static bool active = false;
+static sigset_t orig_mask;
+static int sig_fd = -1;                 // signalfd, or the read end of the self-pipe
+static map<int, function<void()>> fd_handlers;
+static map<int, function<void()>> sig_handlers;
+static int cached_cols = 0;
+
+static void refresh_cols() {
+    struct winsize w;
+    cached_cols = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_col > 0) ? w.ws_col : 80;
+}
+
+int term_cols() {
+    if (!cached_cols || !active) refresh_cols();
+    return cached_cols;
+}
+
+#ifdef __linux__
+static int ep_fd = -1;
+
+bool reactor_init() {
+    sigset_t set;
+    sigemptyset(&set);
+    for (int s : reactor_signals) sigaddset(&set, s);
+    if (sigprocmask(SIG_BLOCK, &set, &orig_mask) < 0) return false;
+    sig_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    ep_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (sig_fd < 0 || ep_fd < 0) {
+        sigprocmask(SIG_SETMASK, &orig_mask, nullptr);
+        return false;
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = sig_fd;
+    epoll_ctl(ep_fd, EPOLL_CTL_ADD, sig_fd, &ev);
+    refresh_cols();
+    active = true;
+    return true;
+}
+
+void reactor_add_fd(int fd, function<void()> on_readable) {
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(ep_fd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno == EEXIST)
+        epoll_ctl(ep_fd, EPOLL_CTL_MOD, fd, &ev);
+    fd_handlers[fd] = on_readable;
+}
+
+void reactor_remove_fd(int fd) {
+    epoll_ctl(ep_fd, EPOLL_CTL_DEL, fd, nullptr);
+    fd_handlers.erase(fd);
+}
+
+static vector<int> pending_signals() {
+    vector<int> sigs;
+    struct signalfd_siginfo si;
+    while (read(sig_fd, &si, sizeof(si)) == (ssize_t)sizeof(si)) sigs.push_back((int)si.ssi_signo);
+    return sigs;
+}
+
+static vector<int> wait_ready(int timeout_ms) {
+    struct epoll_event evs[16];
+    int n = epoll_wait(ep_fd, evs, 16, timeout_ms);
+    vector<int> ready;
+    for (int i = 0; i < n; ++i) ready.push_back(evs[i].data.fd);
+    return ready;
+}
+#else
+static int sig_pipe[2] = {-1, -1};
+
+static void forward_to_pipe(int signo) {
+    int saved = errno;
+    unsigned char b = (unsigned char)signo;
+    (void)!write(sig_pipe[1], &b, 1);
+    errno = saved;
+}
+
+bool reactor_init() {
+    if (pipe(sig_pipe) < 0) return false;
+    for (int fd : sig_pipe) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    sig_fd = sig_pipe[0];
+    sigprocmask(SIG_SETMASK, nullptr, &orig_mask);
+    struct sigaction sa = {};
+    sa.sa_handler = forward_to_pipe;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    for (int s : reactor_signals) sigaction(s, &sa, nullptr);
+    refresh_cols();
+    active = true;
+    return true;
+}
+
+void reactor_add_fd(int fd, function<void()> on_readable) { fd_handlers[fd] = on_readable; }
+void reactor_remove_fd(int fd) { fd_handlers.erase(fd); }
+
+static vector<int> pending_signals() {
+    vector<int> sigs;
+    unsigned char b;
+    while (read(sig_fd, &b, 1) == 1) sigs.push_back(b);
+    return sigs;
+}
+
+static vector<int> wait_ready(int timeout_ms) {
+    vector<struct pollfd> pfds;
+    pfds.push_back({sig_fd, POLLIN, 0});
+    for (auto& h : fd_handlers) pfds.push_back({h.first, POLLIN, 0});
+    vector<int> ready;
+    if (poll(pfds.data(), pfds.size(), timeout_ms) <= 0) return ready;
+    for (auto& p : pfds) if (p.revents) ready.push_back(p.fd);
+    return ready;
+}
+#endif
+
+bool reactor_active() { return active; }
+
+void reactor_on_signal(int signo, function<void()> fn) { sig_handlers[signo] = fn; }
+
+void reactor_run_once(int timeout_ms) {
+    for (int fd : wait_ready(timeout_ms)) {
+        if (fd == sig_fd) {
+            for (int s : pending_signals()) {
+                if (s == SIGWINCH) refresh_cols();
+                auto h = sig_handlers.find(s);
+                if (h != sig_handlers.end()) h->second();
+            }
+            continue;
+        }
+        auto h = fd_handlers.find(fd); // a handler may have removed it
+        if (h != fd_handlers.end()) {
+            auto fn = h->second;
+            fn();
+        }
+    }
+}
+
+void reactor_child_reset() {
+    if (!active) return;
+    for (int s : reactor_signals) signal(s, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &orig_mask, nullptr);
+    active = false;
+}
@@ -0,0 +1,58 @@
+#include "script.h"
+#include "parser.h"
+#include "scriptcache.h"
+#include "interp.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <iostream>
+#include <string>
+using namespace std;
+
+// Parsing depends on nothing but the text ($VAR and wildcards are expanded
+// when a command runs), so a whole script is parsed up front. A syntax
+// error anywhere means nothing runs.
+bool compile_script(const string& text, Node& out) {
+    string err;
+    if (parse_script(text, out, err, true) == PARSE_OK) return true;
+    cerr << "mysh: " << err << "\n";
+    return false;
+}
+
+static int run_compiled(Node& root) {
+    int status = run_tree(root);
+    free_tree(root);
+    return status;
+}
+
+int run_script(const string& text) {
+    Node root;
+    if (!compile_script(text, root)) return 2;
+    return run_compiled(root);
+}
+
+static bool read_file(const string& path, size_t size_hint, string& text) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    text.reserve(size_hint);
+    char buf[65536];
+    ssize_t r;
+    while ((r = read(fd, buf, sizeof(buf))) > 0) text.append(buf, (size_t)r);
+    close(fd);
+    return r == 0;
+}
+
+int run_script_file(const string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) { perror(path.c_str()); return 127; }
+    bool cache = script_cache_enabled();
+    Node root;
+    if (!cache || !script_cache_load(path, st, root)) {
+        string text;
+        if (!read_file(path, (size_t)st.st_size, text)) { perror(path.c_str()); return 126; }
+        if (!compile_script(text, root)) return 2;
+        if (cache) script_cache_store(path, st, root);
+    }
+    return run_compiled(root);
+}
@@ -0,0 +1,334 @@
+#include "scriptcache.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+using namespace std;
+
+#ifdef __linux__
+#define ST_MTIM(st) (st).st_mtim
+#else
+#define ST_MTIM(st) (st).st_mtimespec
+#endif
+
+// Bump when Node/Parsed/CmdStage or the encoding below changes.
+static const uint32_t CACHE_FORMAT = 6;
+static const char CACHE_MAGIC[8] = {'M', 'Y', 'S', 'H', 'C', 0, 0, 0};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t nodes;
+    uint64_t shell_id;     // identity of the binary that wrote the entry
+    uint64_t script_size;
+    int64_t mtime_sec, mtime_nsec;
+    uint64_t hits;         // bumped in place on every hit
+    uint32_t path_len;     // script path follows the header, then the body
+    uint32_t body_len;
+};
+
+static uint64_t fnv1a(const void* data, size_t n, uint64_t h = 1469598103934665603ULL) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+// A rebuilt shell may parse differently, so entries are tied to the binary
+// (or, where it can't be found, to this file's build time).
+static uint64_t shell_id() {
+    static uint64_t id = 0;
+    if (id) return id;
+    const char* stamp = __DATE__ " " __TIME__;
+    id = fnv1a(stamp, strlen(stamp));
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        uint64_t key[4] = {(uint64_t)st.st_ino, (uint64_t)st.st_size,
+                           (uint64_t)ST_MTIM(st).tv_sec, (uint64_t)ST_MTIM(st).tv_nsec};
+        id = fnv1a(key, sizeof(key), id);
+    }
+    id ^= CACHE_FORMAT;
+    return id;
+}
+
+bool script_cache_enabled() {
+    const char* v = getenv("MYSH_SCRIPT_CACHE");
+    return !v || !(strcmp(v, "off") == 0 || strcmp(v, "0") == 0);
+}
+
+static string cache_dir() {
+    if (const char* d = getenv("MYSH_CACHE_DIR")) return d;
+    if (const char* x = getenv("XDG_CACHE_HOME")) return string(x) + "/mysh";
+    const char* home = getenv("HOME");
+    return string(home ? home : "/tmp") + "/.cache/mysh";
+}
+
+static string entry_path(const string& script) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.myshc", (unsigned long long)fnv1a(script.data(), script.size()));
+    return cache_dir() + name;
+}
+
+static string real_path(const string& path) {
+    char buf[PATH_MAX];
+    return realpath(path.c_str(), buf) ? string(buf) : path;
+}
+
+// ---------- Encoding ----------
+// Little more than length-prefixed strings; decoding allocates argv the way
+// the parser does, so run_parsed/free_parsed treat both the same.
+static void put_u32(string& out, uint32_t v) { out.append((const char*)&v, sizeof(v)); }
+static void put_str(string& out, const string& s) { put_u32(out, (uint32_t)s.size()); out += s; }
+
+static void encode(string& out, const Parsed& p) {
+    out += (char)p.background;
+    put_u32(out, (uint32_t)p.stages.size());
+    for (auto& st : p.stages) {
+        out += (char)((st.append ? 1 : 0) | (st.has_here ? 2 : 0) | (st.here_expand ? 4 : 0) | (st.meter ? 8 : 0));
+        put_u32(out, (uint32_t)st.argv.size() - 1); // without the terminating nullptr
+        for (char* a : st.argv) if (a) put_str(out, a);
+        put_u32(out, (uint32_t)st.assigns.size());
+        for (auto& a : st.assigns) put_str(out, a);
+        put_str(out, st.infile);
+        put_str(out, st.outfile);
+        put_str(out, st.here_delim);
+        put_str(out, st.here_body);
+    }
+    put_u32(out, (uint32_t)p.fanout.size());
+    for (auto& f : p.fanout) encode(out, f);
+}
+
+static void encode_node(string& out, const Node& n, uint32_t& count) {
+    ++count;
+    out += (char)n.kind;
+    out += (char)((n.has_else ? 1 : 0) | (n.background ? 2 : 0));
+    if (n.kind == N_PIPELINE) encode(out, n.cmd);
+    if (n.kind == N_FOR) {
+        put_str(out, n.var);
+        put_u32(out, (uint32_t)n.words.size());
+        for (auto& w : n.words) put_str(out, w);
+    }
+    if (n.kind == N_ANDOR) put_str(out, n.ops);
+    put_u32(out, (uint32_t)n.kids.size());
+    for (auto& k : n.kids) encode_node(out, k, count);
+}
+
+struct Reader {
+    const char* p;
+    const char* end;
+    bool ok = true;
+    bool need(size_t n) { if ((size_t)(end - p) < n) ok = false; return ok; }
+    uint8_t u8() { if (!need(1)) return 0; return (uint8_t)*p++; }
+    uint32_t u32() {
+        uint32_t v = 0;
+        if (!need(sizeof(v))) return 0;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
+    string str() {
+        uint32_t n = u32();
+        if (!need(n)) return "";
+        string s(p, n);
+        p += n;
+        return s;
+    }
+    char* cstr() {
+        uint32_t n = u32();
+        if (!need(n)) return nullptr;
+        char* c = (char*)malloc(n + 1);
+        memcpy(c, p, n);
+        c[n] = '\0';
+        p += n;
+        return c;
+    }
+};
+
+static bool decode(Reader& r, Parsed& p, bool nested = false) {
+    p.background = r.u8() != 0;
+    uint32_t nstages = r.u32();
+    for (uint32_t i = 0; i < nstages && r.ok; ++i) {
+        CmdStage st;
+        uint8_t flags = r.u8();
+        st.append = flags & 1;
+        st.has_here = flags & 2;
+        st.here_expand = flags & 4;
+        st.meter = flags & 8;
+        uint32_t nargv = r.u32();
+        for (uint32_t k = 0; k < nargv && r.ok; ++k) {
+            char* a = r.cstr();
+            if (a) st.argv.push_back(a);
+        }
+        st.argv.push_back(nullptr);
+        uint32_t nassign = r.u32();
+        for (uint32_t k = 0; k < nassign && r.ok; ++k) st.assigns.push_back(r.str());
+        st.infile = r.str();
+        st.outfile = r.str();
+        st.here_delim = r.str();
+        st.here_body = r.str();
+        p.stages.push_back(move(st));
+    }
+    uint32_t nfan = r.u32();
+    for (uint32_t i = 0; i < nfan && r.ok; ++i) {
+        p.fanout.emplace_back();
+        if (nested || !decode(r, p.fanout.back(), true)) return false; // branches don't nest
+    }
+    return r.ok;
+}
+
+static bool decode_node(Reader& r, Node& n, uint32_t& count, int depth) {
+    if (depth > NODE_DEPTH_MAX) return false; // deeper than parse_script builds
+    ++count;
+    uint8_t kind = r.u8();
+    if (kind > N_FOR) return false;
+    n.kind = (NodeKind)kind;
+    uint8_t flags = r.u8();
+    n.has_else = flags & 1;
+    n.background = flags & 2;
+    if (n.kind == N_PIPELINE && !decode(r, n.cmd)) return false;
+    if (n.kind == N_FOR) {
+        n.var = r.str();
+        uint32_t nwords = r.u32();
+        for (uint32_t k = 0; k < nwords && r.ok; ++k) n.words.push_back(r.str());
+    }
+    if (n.kind == N_ANDOR) n.ops = r.str();
+    uint32_t nkids = r.u32();
+    for (uint32_t k = 0; k < nkids && r.ok; ++k) {
+        n.kids.emplace_back();
+        if (!decode_node(r, n.kids.back(), count, depth + 1)) return false;
+    }
+    if (n.kind == N_ANDOR && (n.kids.size() < 2 || n.ops.size() + 1 != n.kids.size())) return false;
+    return r.ok;
+}
+
+// ---------- Load / store ----------
+bool script_cache_load(const string& path, const struct stat& st, Node& out) {
+    string script = real_path(path);
+    string entry = entry_path(script);
+    bool writable = true;
+    int fd = open(entry.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) { writable = false; fd = open(entry.c_str(), O_RDONLY | O_CLOEXEC); }
+    if (fd < 0) return false;
+    struct stat cst;
+    if (fstat(fd, &cst) < 0 || (size_t)cst.st_size < sizeof(CacheHeader)) { close(fd); return false; }
+    size_t len = (size_t)cst.st_size;
+    void* map = mmap(nullptr, len, writable ? PROT_READ | PROT_WRITE : PROT_READ, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    CacheHeader* h = (CacheHeader*)map;
+    const char* base = (const char*)map + sizeof(CacheHeader);
+    bool ok = memcmp(h->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && h->format == CACHE_FORMAT
+        && h->shell_id == shell_id() && h->script_size == (uint64_t)st.st_size
+        && h->mtime_sec == (int64_t)ST_MTIM(st).tv_sec && h->mtime_nsec == (int64_t)ST_MTIM(st).tv_nsec
+        && sizeof(CacheHeader) + (size_t)h->path_len + h->body_len == len
+        && script.compare(0, string::npos, base, h->path_len) == 0;
+    if (ok) {
+        Reader r{base + h->path_len, base + h->path_len + h->body_len};
+        uint32_t count = 0;
+        ok = decode_node(r, out, count, 0) && count == h->nodes && r.p == r.end;
+        if (!ok) free_tree(out);
+        else if (writable) __atomic_add_fetch(&h->hits, 1, __ATOMIC_RELAXED);
+    }
+    munmap(map, len);
+    return ok;
+}
+
+static bool write_all(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+static void make_dirs(const string& dir) {
+    for (size_t i = 1; i <= dir.size(); ++i)
+        if (i == dir.size() || dir[i] == '/') mkdir(dir.substr(0, i).c_str(), 0700);
+}
+
+void script_cache_store(const string& path, const struct stat& st, const Node& root) {
+    // A script changed within the last second could change again with the
+    // same mtime on coarse-grained filesystems; don't cache it yet.
+    if (ST_MTIM(st).tv_sec >= time(nullptr) - 1) return;
+    string script = real_path(path);
+    string body;
+    uint32_t count = 0;
+    encode_node(body, root, count);
+
+    CacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    h.format = CACHE_FORMAT;
+    h.nodes = count;
+    h.shell_id = shell_id();
+    h.script_size = (uint64_t)st.st_size;
+    h.mtime_sec = ST_MTIM(st).tv_sec;
+    h.mtime_nsec = ST_MTIM(st).tv_nsec;
+    h.path_len = (uint32_t)script.size();
+    h.body_len = (uint32_t)body.size();
+
+    // Written aside and renamed, so a concurrent run never maps a partial file
+    string dir = cache_dir();
+    make_dirs(dir);
+    string entry = entry_path(script);
+    string tmp = entry + "." + to_string(getpid());
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    bool ok = write_all(fd, (const char*)&h, sizeof(h)) && write_all(fd, script.data(), script.size())
+        && write_all(fd, body.data(), body.size());
+    close(fd);
+    if (!ok || rename(tmp.c_str(), entry.c_str()) < 0) unlink(tmp.c_str());
+}
+
+// One line per entry: hits, size, state and the script it belongs to.
+int script_cache_report() {
+    string dir = cache_dir();
+    cout << "script cache: " << dir << (script_cache_enabled() ? "" : " (disabled)") << "\n";
+    DIR* d = opendir(dir.c_str());
+    if (!d) { cout << "0 entries\n"; return 0; }
+    unsigned long entries = 0, bytes = 0, hits = 0, stale = 0;
+    while (struct dirent* e = readdir(d)) {
+        size_t n = strlen(e->d_name);
+        if (n < 6 || strcmp(e->d_name + n - 6, ".myshc") != 0) continue;
+        string file = dir + "/" + e->d_name;
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        struct stat cst;
+        CacheHeader h;
+        string script;
+        bool ok = fstat(fd, &cst) == 0 && read(fd, &h, sizeof(h)) == (ssize_t)sizeof(h)
+            && memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && h.path_len < PATH_MAX;
+        if (ok) {
+            script.resize(h.path_len);
+            ok = read(fd, &script[0], h.path_len) == (ssize_t)h.path_len;
+        }
+        close(fd);
+        if (!ok) continue;
+
+        struct stat sst;
+        const char* state = "";
+        if (h.format != CACHE_FORMAT || h.shell_id != shell_id()) state = " (other shell build)";
+        else if (stat(script.c_str(), &sst) < 0) state = " (script missing)";
+        else if ((uint64_t)sst.st_size != h.script_size || ST_MTIM(sst).tv_sec != h.mtime_sec
+                 || ST_MTIM(sst).tv_nsec != h.mtime_nsec) state = " (stale)";
+        if (*state) ++stale;
+        ++entries;
+        bytes += (unsigned long)cst.st_size;
+        hits += h.hits;
+        printf("%8llu %8lld  %s%s\n", (unsigned long long)h.hits, (long long)cst.st_size, script.c_str(), state);
+    }
+    closedir(d);
+    fflush(stdout);
+    cout << entries << " entries, " << bytes << " bytes, " << hits << " hits, " << stale << " unusable\n";
+    return 0;
+}
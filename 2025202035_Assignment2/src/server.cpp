@@ -0,0 +1,162 @@
+#include "server.h"
+#include "script.h"
+#include "frame.h"
+#include "zygote.h"
+#include "jobs.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+using namespace std;
+
+static void set_cloexec(int fd) { fcntl(fd, F_SETFD, FD_CLOEXEC); }
+
+// Copy the task's stdout/stderr pipes into frames until both are closed,
+// or until stop_fd turns readable (the script has returned): then only
+// what is already in the pipes is sent. A background job started by the
+// request keeps the write ends, and the reply doesn't wait for it; what
+// it writes later fails with EPIPE.
+static void relay_output(int conn, int out_fd, int err_fd, int stop_fd, bool* ok) {
+    struct pollfd pf[3] = {{out_fd, POLLIN, 0}, {err_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+    const char types[2] = {FRAME_STDOUT, FRAME_STDERR};
+    int open_fds = 2;
+    bool draining = false;
+    char buf[65536];
+    while (open_fds > 0) {
+        if (!draining && poll(pf, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!draining && (pf[2].revents & (POLLIN | POLLHUP))) {
+            draining = true;
+            for (int k = 0; k < 2; ++k)
+                if (pf[k].fd >= 0) fcntl(pf[k].fd, F_SETFL, fcntl(pf[k].fd, F_GETFL) | O_NONBLOCK);
+        }
+        for (int k = 0; k < 2; ++k) {
+            if (pf[k].fd < 0 || (!draining && !(pf[k].revents & (POLLIN | POLLHUP | POLLERR)))) continue;
+            ssize_t r = read(pf[k].fd, buf, sizeof(buf));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) { close(pf[k].fd); pf[k].fd = -1; --open_fds; continue; } // EOF, or drained
+            if (*ok) *ok = write_frame(conn, types[k], buf, (uint32_t)r);
+        }
+    }
+}
+
+// A request runs inside the session process, which is already warm
+// (history, environment, builtins); only external commands fork. Shell
+// state such as cd or export carries over between requests of a connection.
+static int run_task(int conn, const string& script) {
+    int out[2], err[2], stop[2];
+    if (pipe(out) < 0) return -1;
+    if (pipe(err) < 0) { close(out[0]); close(out[1]); return -1; }
+    if (pipe(stop) < 0) { close(out[0]); close(out[1]); close(err[0]); close(err[1]); return -1; }
+    set_cloexec(out[0]);
+    set_cloexec(err[0]);
+    set_cloexec(stop[0]);
+    set_cloexec(stop[1]);
+
+    int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+    set_cloexec(saved_out);
+    set_cloexec(saved_err);
+    dup2(out[1], STDOUT_FILENO);
+    dup2(err[1], STDERR_FILENO);
+    close(out[1]);
+    close(err[1]);
+
+    bool ok = true;
+    thread relay(relay_output, conn, out[0], err[0], stop[0], &ok);
+    int rc = run_script(script);
+    cout.flush();
+    cerr.flush();
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    close(stop[1]); // the relay sends what is buffered and stops
+    relay.join();
+    close(stop[0]);
+
+    if (ok) ok = write_exit_frame(conn, rc);
+    return ok ? 0 : -1;
+}
+
+static void serve_connection(int conn) {
+    set_cloexec(conn);
+    int devnull = open("/dev/null", O_RDONLY);
+    if (devnull >= 0) { dup2(devnull, STDIN_FILENO); close(devnull); }
+    char type;
+    string payload;
+    while (read_frame(conn, type, payload)) {
+        if (type != FRAME_CMD) continue;
+        if (run_task(conn, payload) < 0) break;
+    }
+    close(conn);
+}
+
+// Sessions are reaped as they end, not at the next accept().
+static void reap_sessions(int) {
+    int saved = errno;
+    while (waitpid(-1, nullptr, WNOHANG) > 0) {}
+    errno = saved;
+}
+
+int run_server(const string& path, int zygote_workers) {
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) { cerr << "mysh: socket path too long\n"; return 1; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) { perror("socket"); return 1; }
+    set_cloexec(lfd);
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path.c_str()); // stale socket
+    mode_t old_mask = umask(077); // the socket is created 0600, never briefly wider
+    int brc = bind(lfd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (brc < 0) { perror("bind"); close(lfd); return 1; }
+    chmod(path.c_str(), 0600);
+    if (listen(lfd, 128) < 0) { perror("listen"); close(lfd); return 1; }
+
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = reap_sessions;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, nullptr);
+    cerr << "mysh: serving on " << path << "\n";
+    while (true) {
+        int conn = accept(lfd, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(lfd);
+            signal(SIGCHLD, SIG_DFL); // the session waits for its own jobs
+            jobs_own();
+            if (zygote_workers > 0) zygote_start(zygote_workers);
+            serve_connection(conn);
+            _exit(0);
+        }
+        close(conn);
+    }
+    close(lfd);
+    unlink(path.c_str());
+    return 1;
+}
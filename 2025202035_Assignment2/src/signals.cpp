@@ -1,4 +1,8 @@
 #include "common.h"
+#include "signals.h"
+#include "reactor.h"
+#include "arrow.h"
+#include "jobs.h"
 #include <csignal>
 #include <iostream>
 #include <unistd.h>
@@ -7,9 +11,11 @@
 
 using namespace std;
 pid_t FG_PGID = 0;       // Foreground process group ID
+volatile sig_atomic_t SHELL_INTERRUPTED = 0; // Ctrl+C seen; stops running loops
 
 // --- SIGINT (Ctrl+C) handler ---
 void sigint_handler(int) {
+    SHELL_INTERRUPTED = 1;
     if (FG_PGID != 0) {
         // Send SIGINT to the whole foreground process group
         kill(-FG_PGID, SIGINT);
@@ -20,8 +26,8 @@ void sigint_handler(int) {
 // --- SIGTSTP (Ctrl+Z) handler ---
 void sigtstp_handler(int) {
     if (FG_PGID != 0) {
-        // Send SIGTSTP to the whole foreground process group
-        cout << "\n[Stopped] " << FG_PGID << "\n";
+        // Send SIGTSTP to the whole foreground process group; the job
+        // table reports the stop
         kill(-FG_PGID, SIGTSTP);
     } 
 }
@@ -45,4 +51,26 @@ void install_shell_signal_handlers() {
     // Ignore terminal job control signals so shell isn’t stopped
     signal(SIGTTOU, SIG_IGN);
     signal(SIGTTIN, SIG_IGN); //
-}
\ No newline at end of file
+}
+
+// With the reactor the same actions run from the event loop, where it is
+// safe to print and to touch readline.
+void install_reactor_signal_handlers() {
+    reactor_on_signal(SIGINT, [] {
+        SHELL_INTERRUPTED = 1;
+        if (FG_PGID != 0) {
+            kill(-FG_PGID, SIGINT);
+            cout << "\n";
+        } else {
+            input_interrupted();
+        }
+    });
+    reactor_on_signal(SIGTSTP, [] {
+        if (FG_PGID != 0) kill(-FG_PGID, SIGTSTP); // the job table reports the stop
+    });
+    reactor_on_signal(SIGCHLD, [] {
+        jobs_reap();
+        jobs_notify();
+    });
+    reactor_on_signal(SIGWINCH, [] { input_resized(); });
+}
@@ -0,0 +1,214 @@
+#include "vars.h"
+#include "arith.h"
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+struct Var {
+    string value;
+    bool exported = false;
+};
+
+// An immutable envp image. A new one replaces the old when an export changes,
+// so a block handed to a spawn is never modified under it.
+struct EnvBlock {
+    vector<string> strs;
+    vector<char*> ptrs;
+};
+
+static unordered_map<string, Var> vars;
+static shared_ptr<EnvBlock> env_cur;
+static bool env_dirty = true;
+
+void vars_init(char** envp) {
+    vars.clear();
+    for (char** e = envp; e && *e; ++e) {
+        const char* eq = strchr(*e, '=');
+        if (!eq) continue;
+        Var v;
+        v.value = eq + 1;
+        v.exported = true;
+        vars[string(*e, eq - *e)] = v;
+    }
+    env_dirty = true;
+}
+
+const char* var_get(const string& name) {
+    auto it = vars.find(name);
+    return it == vars.end() ? nullptr : it->second.value.c_str();
+}
+
+void var_set(const string& name, const string& value, bool exported) {
+    Var& v = vars[name];
+    if (v.value == value && (v.exported || !exported)) return;
+    v.value = value;
+    if (exported) v.exported = true;
+    if (v.exported) env_dirty = true;
+}
+
+void var_unset(const string& name) {
+    auto it = vars.find(name);
+    if (it == vars.end()) return;
+    if (it->second.exported) env_dirty = true;
+    vars.erase(it);
+}
+
+void var_export(const string& name) {
+    Var& v = vars[name];
+    if (!v.exported) {
+        v.exported = true;
+        env_dirty = true;
+    }
+}
+
+static bool name_start(char c) { return isalpha((unsigned char)c) || c == '_'; }
+static bool name_char(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+// Length of the [A-Za-z_][A-Za-z0-9_]* name at the start of s, 0 if none.
+static size_t name_len(const char* s) {
+    if (!name_start(s[0])) return 0;
+    size_t n = 1;
+    while (name_char(s[n])) ++n;
+    return n;
+}
+
+bool is_assignment(const char* tok) {
+    size_t n = tok ? name_len(tok) : 0;
+    return n && tok[n] == '=';
+}
+
+// Index just past the "))" closing an arithmetic expansion whose text
+// starts at `from`, or npos.
+size_t arith_end(const string& s, size_t from) {
+    int depth = 0;
+    for (size_t k = from; k < s.size(); ++k) {
+        if (s[k] == '(') ++depth;
+        else if (s[k] == ')') {
+            if (depth == 0) return k + 1 < s.size() && s[k + 1] == ')' ? k + 2 : string::npos;
+            --depth;
+        }
+    }
+    return string::npos;
+}
+
+// $NAME, ${NAME} and $((expr)); nothing is expanded inside single quotes.
+string expand_vars(const string& word, bool unquote) {
+    if (word.find_first_of(unquote ? "$'\"" : "$") == string::npos) return word;
+    string out;
+    bool in_squote = false, in_dquote = false;
+    for (size_t i = 0; i < word.size(); ++i) {
+        char c = word[i];
+        // A quote opens only if it is closed later in the word, as in the lexer.
+        bool& in = c == '\'' ? in_squote : in_dquote;
+        if ((c == '\'' && !in_dquote) || (c == '"' && !in_squote)) {
+            if (in || word.find(c, i + 1) != string::npos) {
+                in = !in;
+                if (!unquote) out += c;
+                continue;
+            }
+        }
+        if (c != '$' || in_squote || i + 1 == word.size()) { out += c; continue; }
+
+        size_t start = i + 1, end;
+        string name;
+        if (word.compare(start, 2, "((") == 0 && (end = arith_end(word, start + 2)) != string::npos) {
+            string expr = word.substr(start + 2, end - start - 4);
+            if (expr.find('$') != string::npos) expr = expand_vars(expr);
+            int64_t v;
+            const char* err;
+            if (arith_eval(expr.data(), expr.size(), v, &err)) out += to_string(v);
+            else cerr << "mysh: " << expr << ": " << err << "\n";
+            i = end - 1;
+            continue;
+        }
+        if (word[start] == '{') {
+            end = word.find('}', start);
+            if (end == string::npos) { out += c; continue; }
+            name = word.substr(start + 1, end - start - 1);
+            i = end;
+        } else if (name_start(word[start])) {
+            end = start;
+            while (end < word.size() && name_char(word[end])) ++end;
+            name = word.substr(start, end - start);
+            i = end - 1;
+        } else {
+            out += c;
+            continue;
+        }
+        const char* v = var_get(name);
+        if (v) out += v;
+    }
+    return out;
+}
+
+char** env_block() {
+    if (env_dirty || !env_cur) {
+        auto blk = make_shared<EnvBlock>();
+        for (auto& kv : vars)
+            if (kv.second.exported) blk->strs.push_back(kv.first + "=" + kv.second.value);
+        for (auto& s : blk->strs) blk->ptrs.push_back(&s[0]);
+        blk->ptrs.push_back(nullptr);
+        env_cur = blk;
+        env_dirty = false;
+    }
+    return env_cur->ptrs.data();
+}
+
+// Per-command `VAR=x cmd`: a private pointer array layered over the shared
+// block. Only pointers are copied; the shared strings are left untouched.
+char** env_with_overrides(const vector<string>& assigns, vector<char*>& scratch) {
+    char** base = env_block();
+    if (assigns.empty()) return base;
+    scratch.clear();
+    for (char** e = base; *e; ++e) scratch.push_back(*e);
+    for (auto& a : assigns) {
+        size_t klen = a.find('=') + 1;
+        bool replaced = false;
+        for (auto& p : scratch) {
+            if (strncmp(p, a.c_str(), klen) == 0) { p = (char*)a.c_str(); replaced = true; break; }
+        }
+        if (!replaced) scratch.push_back((char*)a.c_str());
+    }
+    scratch.push_back(nullptr);
+    return scratch.data();
+}
+
+int builtin_export(char** args) {
+    if (!args[1]) {
+        for (auto& kv : vars)
+            if (kv.second.exported) cout << "export " << kv.first << "=\"" << kv.second.value << "\"\n";
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; args[i]; i++) {
+        string a = args[i];
+        size_t eq = a.find('=');
+        string name = a.substr(0, eq);
+        if (name.empty() || name_len(name.c_str()) != name.size()) {
+            cerr << "export: `" << a << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        if (eq == string::npos) var_export(name);
+        else var_set(name, a.substr(eq + 1), true);
+    }
+    return status;
+}
+
+int builtin_unset(char** args) {
+    int status = 0;
+    for (int i = 1; args[i]; i++) {
+        if (!args[i][0] || args[i][name_len(args[i])]) {
+            cerr << "unset: `" << args[i] << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        var_unset(args[i]);
+    }
+    return status;
+}
@@ -0,0 +1,130 @@
+#include "warmup.h"
+#include "common.h"
+#include "vars.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+using namespace std;
+
+struct WarmDir {
+    string dir;
+    struct stat st;         // taken before the read
+    struct timespec read_at;
+    DirListing entries;     // nullptr: missing (or not a directory) at the scan
+    vector<string> execs;
+};
+
+struct WarmHit {
+    string full;
+    size_t dir; // index in dirs
+};
+
+struct WarmResult {
+    string path;                            // PATH value the index was built for
+    vector<WarmDir> dirs;                   // PATH order, missing ones included
+    unordered_map<string, WarmHit> resolve; // name -> first match on PATH
+};
+
+static mutex warm_mu;
+static unique_ptr<WarmResult> warm_done; // handed over under warm_mu
+static unique_ptr<WarmResult> warm;      // adopted; main thread only
+
+static void warm_thread(string path) {
+    auto res = make_unique<WarmResult>();
+    res->path = path;
+    for (auto& dir : split_simple(path, ':')) {
+        if (dir.empty()) continue;
+        res->dirs.emplace_back();
+        WarmDir& wd = res->dirs.back();
+        wd.dir = dir;
+        if (stat(dir.c_str(), &wd.st) != 0 || !S_ISDIR(wd.st.st_mode)) continue;
+        clock_gettime(CLOCK_REALTIME, &wd.read_at);
+        DIR* d = opendir(dir.c_str());
+        if (!d) continue;
+        auto v = make_shared<vector<DirEntry>>();
+        struct dirent* e;
+        while ((e = readdir(d))) {
+            if (e->d_name[0] == '.' && (e->d_name[1] == '\0' || (e->d_name[1] == '.' && e->d_name[2] == '\0'))) continue;
+            v->push_back({e->d_name, e->d_type});
+        }
+        closedir(d);
+        for (auto& ent : *v) {
+            string full = dir + "/" + ent.name;
+            struct stat st;
+            if (stat(full.c_str(), &st) != 0 || S_ISDIR(st.st_mode) || !(st.st_mode & S_IXUSR)) continue;
+            wd.execs.push_back(ent.name);
+            res->resolve.emplace(ent.name, WarmHit{full, res->dirs.size() - 1}); // earlier PATH entries win
+        }
+        wd.entries = v;
+    }
+    lock_guard<mutex> lk(warm_mu);
+    warm_done = move(res);
+}
+
+void warmup_start() {
+    const char* p = var_get("PATH");
+    if (!p) return;
+    thread(warm_thread, string(p)).detach();
+}
+
+bool warmup_poll() {
+    if (warm) return true;
+    unique_lock<mutex> lk(warm_mu, try_to_lock);
+    if (!lk.owns_lock() || !warm_done) return false;
+    warm = move(warm_done);
+    lk.unlock();
+    for (auto& wd : warm->dirs)
+        if (wd.entries) dir_cache_insert(wd.dir, wd.st, wd.read_at, wd.entries);
+    return true;
+}
+
+const vector<string>* warm_execs(const DirListing& listing) {
+    if (!warm || !listing) return nullptr;
+    for (auto& wd : warm->dirs)
+        if (wd.entries == listing) return &wd.execs;
+    return nullptr;
+}
+
+static bool has_name(const DirListing& l, const char* name) {
+    if (l)
+        for (auto& e : *l)
+            if (e.name == name) return true;
+    return false;
+}
+
+// Whether PATH directory k still agrees with the scan about `name`. Only a
+// listing that really changed is searched; one that merely fell out of the
+// directory cache and was re-read is adopted again.
+static bool dir_agrees(WarmDir& wd, const char* name, bool present) {
+    DirListing now = dir_entries(wd.dir);
+    if (now == wd.entries) return true;
+    if (now && wd.entries) {
+        bool same = now->size() == wd.entries->size();
+        for (size_t i = 0; same && i < now->size(); i++) same = (*now)[i].name == (*wd.entries)[i].name;
+        if (same) {
+            wd.entries = now;
+            return true;
+        }
+    }
+    return has_name(now, name) == present;
+}
+
+const char* path_resolve(const char* name) {
+    if (!name || strchr(name, '/') || !warmup_poll()) return nullptr;
+    const char* path = var_get("PATH");
+    if (!path || warm->path != path) return nullptr;
+    auto it = warm->resolve.find(name);
+    if (it == warm->resolve.end()) return nullptr;
+    // Only the directory of the hit and those before it can change the
+    // answer: an earlier one may now shadow it. Anything doubtful falls
+    // back to the ordinary PATH search.
+    size_t k = it->second.dir;
+    for (size_t j = 0; j <= k; j++)
+        if (!dir_agrees(warm->dirs[j], name, j == k)) return nullptr;
+    return it->second.full.c_str();
+}
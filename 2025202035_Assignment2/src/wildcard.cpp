@@ -0,0 +1,243 @@
+#include "wildcard.h"
+#include "dircache.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+using namespace std;
+
+// ---------- Compiled pattern ----------
+struct Segment {
+    string pat;            // raw segment text
+    bool literal = false;  // no metacharacters at all
+    bool globstar = false; // "**": zero or more directories
+    bool dot_ok = false;   // pattern itself starts with '.', may match hidden names
+    string prefix;         // literal run before the first metacharacter
+    string suffix;         // literal run after the last metacharacter
+    size_t min_len = 0;    // characters any match must have
+};
+
+static bool is_meta(char c) { return c == '*' || c == '?' || c == '['; }
+
+bool has_glob_meta(const string& word) {
+    if (word.find_first_of("'\"") != string::npos) return false; // quoted: leave alone
+    for (size_t i = 0; i < word.size(); ++i) {
+        if (word[i] == '\\') { ++i; continue; }
+        if (is_meta(word[i])) return true;
+    }
+    return false;
+}
+
+// Length of the [...] class starting at p[0] == '[', or 0 if unterminated.
+static size_t class_len(const char* p, const char* end) {
+    const char* q = p + 1;
+    if (q < end && (*q == '!' || *q == '^')) ++q;
+    if (q < end && *q == ']') ++q;
+    while (q < end && *q != ']') ++q;
+    return q < end ? (size_t)(q - p + 1) : 0;
+}
+
+static bool class_match(const char* p, size_t len, char c) {
+    const char* q = p + 1;
+    const char* end = p + len - 1;
+    bool neg = (*q == '!' || *q == '^');
+    if (neg) ++q;
+    bool hit = false;
+    for (bool first = true; q < end; first = false) {
+        char lo = *q;
+        if (lo == ']' && !first) break;
+        if (q + 2 < end && q[1] == '-') {
+            if ((unsigned char)c >= (unsigned char)lo && (unsigned char)c <= (unsigned char)q[2]) hit = true;
+            q += 3;
+        } else {
+            if (c == lo) hit = true;
+            ++q;
+        }
+    }
+    return hit != neg;
+}
+
+// Iterative matcher with a single backtrack point for the last '*':
+// linear in the name for the common patterns, never exponential.
+static bool wild(const char* p, const char* pend, const char* s, const char* send) {
+    const char* star_p = nullptr;
+    const char* star_s = nullptr;
+    while (s < send) {
+        if (p < pend) {
+            char c = *p;
+            if (c == '*') {
+                while (p < pend && *p == '*') ++p;
+                if (p == pend) return true;
+                star_p = p;
+                star_s = s;
+                continue;
+            }
+            if (c == '?') { ++p; ++s; continue; }
+            if (c == '[') {
+                size_t cl = class_len(p, pend);
+                if (cl && class_match(p, cl, *s)) { p += cl; ++s; continue; }
+                if (!cl && *s == '[') { ++p; ++s; continue; }
+            } else {
+                if (c == '\\' && p + 1 < pend) ++p, c = *p;
+                if (c == *s) { ++p; ++s; continue; }
+            }
+        }
+        if (!star_p) return false;
+        p = star_p;
+        s = ++star_s;
+    }
+    while (p < pend && *p == '*') ++p;
+    return p == pend;
+}
+
+static Segment compile_segment(const string& text) {
+    Segment sg;
+    sg.pat = text;
+    sg.globstar = (text == "**");
+    sg.dot_ok = !text.empty() && text[0] == '.';
+    size_t first = string::npos, last = string::npos;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\') { ++i; continue; }
+        if (is_meta(text[i])) {
+            if (first == string::npos) first = i;
+            last = i;
+            if (text[i] == '[') { size_t cl = class_len(text.c_str() + i, text.c_str() + text.size()); if (cl) i += cl - 1, last = i; }
+        }
+    }
+    sg.literal = (first == string::npos);
+    if (sg.literal) {
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '\\' && i + 1 < text.size()) ++i;
+            sg.prefix += text[i];
+        }
+        sg.min_len = sg.prefix.size();
+        return sg;
+    }
+    // Literal anchors; only taken when free of escapes to keep them exact.
+    string pre = text.substr(0, first), suf = text.substr(last + 1);
+    if (pre.find('\\') == string::npos) sg.prefix = pre;
+    if (suf.find('\\') == string::npos) sg.suffix = suf;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '*') continue;
+        if (text[i] == '\\') ++i;
+        else if (text[i] == '[') { size_t cl = class_len(text.c_str() + i, text.c_str() + text.size()); if (cl) i += cl - 1; }
+        ++sg.min_len;
+    }
+    return sg;
+}
+
+// Cheap rejections first (length, literal prefix/suffix via memcmp), then
+// the full matcher only for the survivors.
+static bool segment_match(const Segment& sg, const char* name, size_t len) {
+    if (name[0] == '.' && !sg.dot_ok) return false;
+    if (sg.literal) return len == sg.prefix.size() && memcmp(name, sg.prefix.data(), len) == 0;
+    if (len < sg.min_len) return false;
+    if (!sg.prefix.empty() && memcmp(name, sg.prefix.data(), sg.prefix.size()) != 0) return false;
+    if (!sg.suffix.empty() && memcmp(name + len - sg.suffix.size(), sg.suffix.data(), sg.suffix.size()) != 0) return false;
+    return wild(sg.pat.data(), sg.pat.data() + sg.pat.size(), name, name + len);
+}
+
+bool glob_match(const string& pattern, const string& name) {
+    return wild(pattern.data(), pattern.data() + pattern.size(), name.data(), name.data() + name.size());
+}
+
+// ---------- Directory walk ----------
+class Expander {
+public:
+    vector<Segment> segs;
+    vector<string> out;
+    bool dir_only = false; // pattern ended in '/': directories only, reported with the '/'
+
+    void run(const string& base, size_t i) {
+        if (i == segs.size()) { out.push_back(base); return; }
+        const Segment& sg = segs[i];
+        bool last = (i + 1 == segs.size());
+
+        if (sg.literal) {
+            string next = join(base, sg.prefix);
+            if (last) {
+                struct stat st;
+                if (dir_only ? stat(next.c_str(), &st) == 0 && S_ISDIR(st.st_mode) : lstat(next.c_str(), &st) == 0)
+                    add(next);
+            } else {
+                run(next, i + 1);
+            }
+            return;
+        }
+
+        const DirListing& ents = list(base);
+        if (sg.globstar) {
+            // Like bash, ** does not descend through symlinks, so link
+            // cycles (d/loop -> .) can't make the walk endless.
+            if (!last) run(base, i + 1); // zero directories
+            for (auto& e : *ents) {
+                if (e.name[0] == '.') continue;
+                bool real_dir = is_dir(base, e, false);
+                if (last && (!dir_only || real_dir || is_dir(base, e, true))) add(join(base, e.name)); // trailing "**": everything below
+                if (real_dir) run(join(base, e.name), i);
+            }
+            return;
+        }
+        for (auto& e : *ents) {
+            if (!segment_match(sg, e.name.c_str(), e.name.size())) continue;
+            if (last) { if (!dir_only || is_dir(base, e, true)) add(join(base, e.name)); }
+            else if (is_dir(base, e, true)) run(join(base, e.name), i + 1);
+        }
+    }
+
+private:
+    unordered_map<string, DirListing> cache; // each directory is looked up once
+
+    static string join(const string& base, const string& name) {
+        if (base.empty()) return name;
+        if (base.back() == '/') return base + name;
+        return base + "/" + name;
+    }
+
+    void add(const string& path) { out.push_back(dir_only ? path + "/" : path); }
+
+    // d_type answers the directory question without a stat in the common case.
+    // follow: a symlink to a directory counts.
+    static bool is_dir(const string& base, const DirEntry& e, bool follow) {
+        if (e.type == DT_DIR) return true;
+        if (e.type != DT_UNKNOWN && (e.type != DT_LNK || !follow)) return false;
+        struct stat st;
+        string path = join(base, e.name);
+        return (follow ? stat(path.c_str(), &st) : lstat(path.c_str(), &st)) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    const DirListing& list(const string& base) {
+        auto it = cache.find(base);
+        if (it != cache.end()) return it->second;
+        DirListing& v = cache[base];
+        v = dir_entries(base.empty() ? "." : base);
+        if (!v) v = make_shared<vector<DirEntry>>();
+        return v;
+    }
+};
+
+vector<string> glob_expand(const string& pattern) {
+    Expander ex;
+    string base;
+    size_t pos = 0;
+    if (!pattern.empty() && pattern[0] == '/') { base = "/"; pos = 1; }
+    while (pos <= pattern.size()) {
+        size_t slash = pattern.find('/', pos);
+        if (slash == string::npos) slash = pattern.size();
+        if (slash > pos) {
+            Segment sg = compile_segment(pattern.substr(pos, slash - pos));
+            // collapse "**/**" runs, they match the same set
+            if (!(sg.globstar && !ex.segs.empty() && ex.segs.back().globstar)) ex.segs.push_back(sg);
+        }
+        pos = slash + 1;
+    }
+    if (ex.segs.empty()) return {};
+    ex.dir_only = pattern.size() > 1 && pattern.back() == '/';
+    ex.run(base, 0);
+    sort(ex.out.begin(), ex.out.end());
+    ex.out.erase(unique(ex.out.begin(), ex.out.end()), ex.out.end());
+    return ex.out;
+}
@@ -0,0 +1,192 @@
+#include "zygote.h"
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
+using namespace std;
+
+#ifdef __linux__
+extern char** environ;
+
+static int zy_sock = -1;    // shell end of the control socket
+static pid_t zy_pid = 0;
+
+static const size_t ZY_MAX_REQ = 192 * 1024; // below the default socket buffer
+
+// Request: header, then NUL-separated cwd, argv..., env...; the three
+// stdio fds travel as SCM_RIGHTS.
+struct ZyHeader {
+    int32_t pgid;
+    uint32_t argc;
+    uint32_t envc;
+};
+
+// A parked child: wait for one request, report our pid, exec.
+static void worker_main(int sock, int notify_fd) {
+    static char buf[ZY_MAX_REQ];
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = {buf, sizeof(buf)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+    if (n < (ssize_t)sizeof(ZyHeader)) _exit(0); // shell went away
+    (void)!write(notify_fd, "x", 1);             // ask for a replacement
+    close(notify_fd);
+
+    int fds[3] = {-1, -1, -1};
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+        memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+
+    ZyHeader hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    setpgid(0, hdr.pgid);
+    pid_t me = getpid();
+    (void)!send(sock, &me, sizeof(me), 0);
+    close(sock);
+
+    char* p = buf + sizeof(hdr);
+    char* end = buf + n;
+    const char* cwd = p;
+    p += strlen(p) + 1;
+    vector<char*> args, envs;
+    for (uint32_t i = 0; i < hdr.argc && p < end; ++i) { args.push_back(p); p += strlen(p) + 1; }
+    for (uint32_t i = 0; i < hdr.envc && p < end; ++i) { envs.push_back(p); p += strlen(p) + 1; }
+    args.push_back(nullptr);
+    envs.push_back(nullptr);
+    if (!args[0]) _exit(127);
+
+    for (int i = 0; i < 3; ++i) {
+        if (fds[i] < 0) continue;
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    if (chdir(cwd) < 0) { perror(cwd); _exit(127); }
+    environ = envs.data();
+    execvp(args[0], args.data());
+    perror(args[0]);
+    _exit(127);
+}
+
+// The helper: keep `n` children parked, replacing each one that is used.
+// CLONE_PARENT makes each parked child a direct child of the shell.
+static void zygote_main(int sock, int n) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    int sigs[] = {SIGINT, SIGTSTP, SIGTTOU, SIGTTIN, SIGCHLD, SIGPIPE};
+    for (int s : sigs) signal(s, SIG_DFL);
+    int notify[2];
+    if (pipe(notify) < 0) _exit(1);
+
+    auto park_one = [&]() {
+        if (syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0) == 0) {
+            close(notify[0]);
+            worker_main(sock, notify[1]);
+        }
+    };
+    for (int i = 0; i < n; ++i) park_one();
+
+    struct pollfd pf[2] = {{notify[0], POLLIN, 0}, {sock, 0, 0}};
+    while (true) {
+        if (poll(pf, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        if (pf[1].revents & (POLLHUP | POLLERR)) _exit(0);
+        if (pf[0].revents & POLLIN) {
+            char b[64];
+            ssize_t r = read(notify[0], b, sizeof(b));
+            for (ssize_t i = 0; i < r; ++i) park_one();
+        }
+    }
+}
+
+bool zygote_start(int nworkers) {
+    if (nworkers <= 0 || zy_sock >= 0) return false;
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) return false;
+    zy_pid = fork();
+    if (zy_pid < 0) { close(sv[0]); close(sv[1]); return false; }
+    if (zy_pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1], nworkers);
+        _exit(0);
+    }
+    close(sv[1]);
+    zy_sock = sv[0];
+    return true;
+}
+
+bool zygote_active() { return zy_sock >= 0; }
+
+void zygote_detach() {
+    if (zy_sock >= 0) close(zy_sock);
+    zy_sock = -1;
+}
+
+pid_t zygote_spawn(char* const argv[], char* const envp[], int fd_in, int fd_out, int fd_err, pid_t pgid) {
+    if (zy_sock < 0) return -1;
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+
+    ZyHeader hdr = {(int32_t)pgid, 0, 0};
+    string req(sizeof(hdr), '\0');
+    req.append(cwd, strlen(cwd) + 1);
+    for (; argv[hdr.argc]; ++hdr.argc) req.append(argv[hdr.argc], strlen(argv[hdr.argc]) + 1);
+    for (; envp[hdr.envc]; ++hdr.envc) req.append(envp[hdr.envc], strlen(envp[hdr.envc]) + 1);
+    if (req.size() > ZY_MAX_REQ) return -1;
+    memcpy(&req[0], &hdr, sizeof(hdr));
+
+    int fds[3] = {fd_in, fd_out, fd_err};
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct iovec iov = {&req[0], req.size()};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    ssize_t w;
+    pid_t pid = -1;
+    while ((w = sendmsg(zy_sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    if (w >= 0)
+        while ((w = recv(zy_sock, &pid, sizeof(pid), 0)) < 0 && errno == EINTR) {}
+    if (w == (ssize_t)sizeof(pid)) return pid;
+
+    // The helper is gone: stop using it.
+    close(zy_sock);
+    zy_sock = -1;
+    return -1;
+}
+
+#else
+
+bool zygote_start(int) { return false; }
+bool zygote_active() { return false; }
+void zygote_detach() {}
+pid_t zygote_spawn(char* const*, char* const*, int, int, int, pid_t) { return -1; }
+
+#endif
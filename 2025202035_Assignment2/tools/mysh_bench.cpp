@@ -0,0 +1,148 @@
+// mysh-bench: per-task latency of `sh -c CMD` versus requests to a running
+// `mysh --server`, and with -z also a server launching through the zygote.
+//   mysh-bench [-n N] [-m ./mysh] [-s SOCKET] [-z WORKERS] [command]
+#include "frame.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using bench_clock = chrono::steady_clock;
+
+static double usec_since(bench_clock::time_point t0) {
+    return chrono::duration<double, micro>(bench_clock::now() - t0).count();
+}
+
+static void report(const char* label, vector<double>& lat) {
+    sort(lat.begin(), lat.end());
+    double sum = 0;
+    for (double v : lat) sum += v;
+    size_t n = lat.size();
+    printf("%-10s n=%zu  mean=%8.1fus  p50=%8.1fus  p99=%8.1fus  %8.0f tasks/s\n",
+           label, n, sum / n, lat[n / 2], lat[min(n - 1, n * 99 / 100)], n / (sum / 1e6));
+}
+
+static int connect_to(const string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+static pid_t start_server(const string& mysh, const string& sock, int zygote) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        string z = to_string(zygote);
+        if (zygote > 0)
+            execl(mysh.c_str(), mysh.c_str(), "--zygote", z.c_str(), "--server", sock.c_str(), (char*)nullptr);
+        else
+            execl(mysh.c_str(), mysh.c_str(), "--server", sock.c_str(), (char*)nullptr);
+        perror(mysh.c_str());
+        _exit(127);
+    }
+    return pid;
+}
+
+static int wait_connect(const string& sock) {
+    int fd = -1;
+    for (int tries = 0; tries < 200 && fd < 0; ++tries) {
+        fd = connect_to(sock);
+        if (fd < 0) usleep(10000);
+    }
+    if (fd < 0) cerr << "mysh-bench: cannot connect to " << sock << "\n";
+    return fd;
+}
+
+static void stop_server(pid_t pid) {
+    if (pid > 0) { kill(pid, SIGTERM); waitpid(pid, nullptr, 0); }
+}
+
+static bool server_task(int fd, const string& cmd) {
+    if (!write_frame(fd, FRAME_CMD, cmd.data(), (uint32_t)cmd.size())) return false;
+    char type;
+    string payload;
+    while (read_frame(fd, type, payload))
+        if (type == FRAME_EXIT) return true;
+    return false;
+}
+
+static bool run_series(const char* label, int fd, const string& cmd, int n, double base) {
+    vector<double> lat;
+    lat.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        auto t0 = bench_clock::now();
+        if (!server_task(fd, cmd)) { cerr << "mysh-bench: server connection lost\n"; return false; }
+        lat.push_back(usec_since(t0));
+    }
+    report(label, lat);
+    double total = 0;
+    for (double v : lat) total += v;
+    printf("%-10s speedup vs sh -c: %.2fx\n", label, base / total);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int n = 1000, zygote = 0;
+    string mysh, sock = "/tmp/mysh-bench.sock", cmd = "true";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:s:z:")) != -1) {
+        if (opt == 'n') n = max(1, atoi(optarg));
+        else if (opt == 'm') mysh = optarg;
+        else if (opt == 's') sock = optarg;
+        else if (opt == 'z') zygote = atoi(optarg);
+        else { cerr << "usage: mysh-bench [-n N] [-m mysh] [-s socket] [-z workers] [command]\n"; return 2; }
+    }
+    if (optind < argc) cmd = argv[optind];
+    if (zygote > 0 && mysh.empty()) { cerr << "mysh-bench: -z needs -m\n"; return 2; }
+
+    pid_t server = mysh.empty() ? 0 : start_server(mysh, sock, 0);
+    int fd = wait_connect(sock);
+    if (fd < 0) return 2;
+
+    printf("command: %s\n", cmd.c_str());
+    vector<double> lat;
+    lat.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        auto t0 = bench_clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            int devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+            execl("/bin/sh", "sh", "-c", cmd.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        waitpid(pid, nullptr, 0);
+        lat.push_back(usec_since(t0));
+    }
+    report("sh -c", lat);
+    double base = 0;
+    for (double v : lat) base += v;
+
+    if (!run_series("server", fd, cmd, n, base)) return 1;
+    close(fd);
+    stop_server(server);
+
+    if (zygote > 0) {
+        server = start_server(mysh, sock, zygote);
+        fd = wait_connect(sock);
+        if (fd < 0) return 2;
+        if (!run_series("zygote", fd, cmd, n, base)) return 1;
+        close(fd);
+        stop_server(server);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+// mysh-client: submit commands to `mysh --server SOCKET`.
+//   mysh-client SOCKET cmd args...   run one command
+//   mysh-client SOCKET < tasks       one request per input line
+//   mysh-client -b SOCKET < script   whole input as a single batch
+#include "frame.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+static int connect_to(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        return -1;
+    }
+    return fd;
+}
+
+// Send one request and copy its output frames to our stdout/stderr.
+static int submit(int fd, const string& cmd) {
+    if (!write_frame(fd, FRAME_CMD, cmd.data(), (uint32_t)cmd.size())) return -1;
+    char type;
+    string payload;
+    while (read_frame(fd, type, payload)) {
+        if (type == FRAME_STDOUT) fwrite(payload.data(), 1, payload.size(), stdout);
+        else if (type == FRAME_STDERR) fwrite(payload.data(), 1, payload.size(), stderr);
+        else if (type == FRAME_EXIT) { fflush(stdout); return exit_frame_status(payload); }
+    }
+    return -1;
+}
+
+int main(int argc, char* argv[]) {
+    bool batch = false;
+    int ai = 1;
+    if (ai < argc && strcmp(argv[ai], "-b") == 0) { batch = true; ++ai; }
+    if (ai >= argc) {
+        cerr << "usage: mysh-client [-b] SOCKET [command...]\n";
+        return 2;
+    }
+    int fd = connect_to(argv[ai++]);
+    if (fd < 0) return 2;
+
+    int rc = 0;
+    if (ai < argc) {
+        string cmd;
+        for (; ai < argc; ++ai) { if (!cmd.empty()) cmd += ' '; cmd += argv[ai]; }
+        rc = submit(fd, cmd);
+    } else if (batch) {
+        string all, line;
+        while (getline(cin, line)) { all += line; all += '\n'; }
+        rc = submit(fd, all);
+    } else {
+        string line;
+        while (rc >= 0 && getline(cin, line)) {
+            if (!line.empty()) rc = submit(fd, line);
+        }
+    }
+    close(fd);
+    if (rc < 0) { cerr << "mysh-client: connection lost\n"; return 2; }
+    return rc;
+}
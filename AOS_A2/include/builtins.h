@@ -1,9 +1,20 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
+#include <string>
 void builtin_cd(char** args);
 void builtin_pwd();
 void builtin_echo(char** args);
 void builtin_ls(char** args);
 void builtin_history(char** args);
 void builtin_search(char** args);
-#endif
\ No newline at end of file
+void builtin_pinfo(char** args);
+
+// Builtin registry, shared by the dispatcher in main.cpp and the
+// highlighter. fn returns the shell status; it is null for the exit
+// builtins, which the main loop handles itself.
+struct Builtin {
+    const char* name;
+    int (*fn)(char** args);
+};
+const Builtin* find_builtin(const std::string& name);
+#endif
@@ -7,6 +7,8 @@
 
 using namespace std;
 
-void run_pipeline(vector<Parsed>& cmds, bool background);
+// Exit status of the last stage (128+signal when killed or stopped, 0 for a
+// background job); peak_kb gets the largest max RSS of the reaped stages.
+int run_pipeline(vector<Parsed>& cmds, bool background, long* peak_kb = nullptr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+#include <string>
+#include <vector>
+
+// Display styles for the line editor; input.cpp maps them to SGR sequences.
+enum {
+    STYLE_PLAIN, STYLE_CONTROL, STYLE_BUILTIN, STYLE_COMMAND, STYLE_BAD_COMMAND,
+    STYLE_STRING, STYLE_REDIRECT, STYLE_OPERATOR, STYLE_SUGGEST
+};
+
+// Incremental lexer for the edited line. Between calls it keeps the token
+// list, so an edit re-lexes from the touched token only until the token
+// stream lines up with the old one again.
+class Highlighter {
+public:
+    // Per-character styles for `line`.
+    const std::vector<unsigned char>& update(const std::string& line);
+
+private:
+    struct Token {
+        size_t start, len;
+        unsigned char kind;
+        unsigned char state;   // lexer state at the token start
+        unsigned char style;   // resolved style of a command name
+    };
+    std::string prev;
+    std::vector<Token> tokens;
+    unsigned char end_state = 1;
+    bool path_ready = false;
+    std::vector<unsigned char> styles;
+
+    void paint(const Token& t, const std::string& line);
+};
+
+#endif
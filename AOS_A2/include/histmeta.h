@@ -0,0 +1,6 @@
+#ifndef AOS_HISTMETA_H
+#define AOS_HISTMETA_H
+// The history sidecar format is shared with the other shell, which writes
+// the same records; there is one copy of it, in that tree.
+#include "../../2025202035_Assignment2/include/histmeta.h"
+#endif
@@ -1,8 +1,19 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 #include <string>
+#include <vector>
+#include <ctime>
 void load_history();
 void save_history();
 void add_history(const std::string& cmd);
 void show_history(int n);
+const std::vector<std::string>& get_history();
+// Most used entry in `cwd` starting with `prefix`, else the most recent one.
+std::string suggest_history(const std::string& prefix, const std::string& cwd);
+// Per-line records in a binary sidecar next to the text history
+// (/tmp/mysh_history.meta): start time, duration, exit status, cwd and peak
+// RSS. Read once and indexed in memory for `history --slowest/--failed/--stats`.
+void history_record(const std::string& cmd, time_t start, double secs, int status, long peak_kb);
+// history --slowest [N] | --failed [N] | --stats [CMD...]; false on a usage error.
+bool history_query(char** args);
 #endif
\ No newline at end of file
@@ -3,8 +3,8 @@
 
 #include <string>
 
-// Function to read a line with arrow key support
-std::string read_line_with_history();
+// Function to read a line with arrow key support (terminal must be in raw mode)
+std::string read_line_with_history(const std::string& prompt);
 
 // Function to set up terminal for raw input
 void setup_raw_mode();
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
 #include <sys/types.h>
 using namespace std;
 
@@ -12,13 +13,18 @@ struct Job {
     string cmd;
     bool running;
     bool stopped;
+    bool done;      // group gone, Done notice not printed yet
+    pid_t last_pid; // last stage; its exit status is the job's
+    int status;
+    chrono::steady_clock::time_point started, ended;
 };
 
 extern vector<Job> jobs;
 
-void add_job(pid_t pid, const string& cmd, bool running = true, bool stopped = false);
+void add_job(pid_t pid, const string& cmd, bool running = true, bool stopped = false, pid_t last_pid = 0);
 void remove_job(pid_t pid);
 void refresh_jobs();                 // <-- NEW: update status
+string job_notices();                // "[n] Done ..." lines for finished jobs, which are then dropped
 void list_jobs(bool verbose = false);
 void fg(int job_id);
 void bg(int job_id);
@@ -0,0 +1,13 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+#include <string>
+
+// Executables found on $PATH, indexed once by a background thread.
+// Lookups only consult memory and never wait on the filesystem.
+enum class PathLookup { Unknown, Found, Missing };
+
+void path_cache_start();
+bool path_cache_ready();
+PathLookup path_cache_lookup(const std::string& name);
+
+#endif
@@ -1,4 +1,6 @@
 #ifndef PROMPT_H
 #define PROMPT_H
+#include <string>
+std::string build_prompt();
 void print_prompt();
 #endif
\ No newline at end of file
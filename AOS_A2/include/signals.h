@@ -2,10 +2,18 @@
 #define SIGNALS_H
 #include <sys/types.h>
 #include <string>
+#include <vector>
 
 extern pid_t fg_pid;
 extern std::string fg_cmd;
 
+// SIGINT, SIGTSTP, SIGCHLD and SIGWINCH are caught by a handler that only
+// writes the signal number to a pipe; wait on signal_fd() alongside input.
 void init_signal_handlers();
+int signal_fd();
 
-#endif
\ No newline at end of file
+// Reads the pipe and handles what arrived (reaping jobs and so on) in normal
+// context; returns the signals seen so the caller can react to them too.
+std::vector<int> handle_signals();
+
+#endif
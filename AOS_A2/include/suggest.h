@@ -0,0 +1,28 @@
+#ifndef SUGGEST_H
+#define SUGGEST_H
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Trie over history entries. Every node remembers the highest-ranked entry
+// below it, so a lookup is one walk down the prefix. Ranks of an entry may
+// only grow (a recency stamp or a use count), which keeps insert a single
+// walk as well.
+class PrefixIndex {
+public:
+    void insert(const std::string& entry, unsigned long rank);
+    const std::string* best(const std::string& prefix) const;
+
+private:
+    struct Node {
+        std::map<char, int> next;
+        int best = -1;            // entry id
+        unsigned long rank = 0;
+    };
+    std::vector<Node> nodes = std::vector<Node>(1);
+    std::vector<std::string> entries;
+    std::unordered_map<std::string, int> ids;
+};
+
+#endif
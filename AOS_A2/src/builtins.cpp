@@ -3,6 +3,7 @@
 #include "prompt.h"
 #include "pinfo.h"
 #include "search.h"
+#include "history.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -295,4 +296,46 @@ void builtin_ls(char** args) {
 
         ls_directory(path, flag_a, flag_l);
     }
-}
\ No newline at end of file
+}
+
+// ---------- Builtin registry ----------
+// The one list of builtins: main.cpp dispatches through it and the
+// highlighter colours the same names. Entries return the shell status.
+static const Builtin builtin_table[] = {
+    {"cd",      [](char** a) { builtin_cd(a); return 0; }},
+    {"pwd",     [](char**) { builtin_pwd(); return 0; }},
+    {"echo",    [](char** a) { builtin_echo(a); return 0; }},
+    {"ls",      [](char** a) { builtin_ls(a); return 0; }},
+    {"search",  [](char** a) { builtin_search(a); return 0; }},
+    {"pinfo",   [](char** a) { builtin_pinfo(a); return 0; }},
+    {"history", [](char** a) {
+        if (a[1] && strncmp(a[1], "--", 2) == 0) return history_query(a) ? 0 : 2;
+        show_history(a[1] ? atoi(a[1]) : 10);
+        return 0;
+    }},
+    {"jobs",    [](char** a) { list_jobs(a[1] && strcmp(a[1], "-v") == 0); return 0; }},
+    {"fg",      [](char** a) {
+        if (!a[1]) { cerr << "fg: usage: fg <job>\n"; return 2; }
+        fg(atoi(a[1]));
+        return 0;
+    }},
+    {"bg",      [](char** a) {
+        if (!a[1]) { cerr << "bg: usage: bg <job>\n"; return 2; }
+        bg(atoi(a[1]));
+        return 0;
+    }},
+    {"sig",     [](char** a) {
+        if (!a[1] || !a[2]) { cerr << "sig: usage: sig <job> <signal>\n"; return 2; }
+        send_sig(atoi(a[1]), atoi(a[2]));
+        return 0;
+    }},
+    {"exit",    nullptr},  // handled by the main loop
+    {"quit",    nullptr},
+    {"exitall", nullptr},
+};
+
+const Builtin* find_builtin(const string& name) {
+    for (auto& b : builtin_table)
+        if (name == b.name) return &b;
+    return nullptr;
+}
@@ -4,6 +4,7 @@
 
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <signal.h>
@@ -34,11 +35,13 @@ static string build_cmd_string(const vector<Parsed>& cmds) {
             out += "| ";
         }
     }
+    if (!out.empty() && out.back() == ' ') out.pop_back();
     return out;
 }
 
-void run_pipeline(vector<Parsed>& cmds, bool background) {
-    if (cmds.empty()) return;
+int run_pipeline(vector<Parsed>& cmds, bool background, long* peak_kb) {
+    if (peak_kb) *peak_kb = 0;
+    if (cmds.empty()) return 0;
 
     int n = (int)cmds.size();
 
@@ -52,7 +55,7 @@ void run_pipeline(vector<Parsed>& cmds, bool background) {
         for (int i = 0; i < n - 1; ++i) {
             if (pipe(&pipefds[2*i]) < 0) {
                 perror("pipe");
-                return;
+                return 1;
             }
         }
     }
@@ -68,16 +71,16 @@ void run_pipeline(vector<Parsed>& cmds, bool background) {
             perror("fork");
             // cleanup pipes
             for (int fd : pipefds) if (fd > 0) close(fd);
-            return;
+            return 1;
         }
 
         if (pid == 0) {
             // === CHILD ===
 
-            // Set process group: each child joins the pipeline group.
-            // In child, setpgid(0, pgid==0 ? 0 : pgid) is problematic since parent sets pgid.
-            // Simpler: in child set its pgid to its own pid; parent will set others to same group.
-            setpgid(0, 0);
+            // Set process group: each child joins the pipeline group. The
+            // first stage starts it (pgid is still 0); the parent makes the
+            // same call, so whichever runs first wins the race harmlessly.
+            setpgid(0, pgid);
 
             // If not first stage: read from previous pipe
             if (i > 0) {
@@ -174,9 +177,9 @@ void run_pipeline(vector<Parsed>& cmds, bool background) {
     // If background: just record job and return to prompt
     if (background) {
         // Add job with pgid (so future signals can target group)
-        add_job(pgid, cmd_str, true);
+        add_job(pgid, cmd_str, true, false, child_pids.back());
         cout << "[" << pgid << "]" << " " << "Started in background\n";
-        return;
+        return 0;
     }
 
     // FOREGROUND: give terminal to child process group, wait for it
@@ -189,6 +192,8 @@ void run_pipeline(vector<Parsed>& cmds, bool background) {
 
     // Wait for the process group to finish or stop
     int status;
+    int last_status = 0;
+    struct rusage ru;
     pid_t wpid;
     bool all_exited = false;
 
@@ -196,7 +201,7 @@ void run_pipeline(vector<Parsed>& cmds, bool background) {
         all_exited = true;  // Assume all processes have exited until proven otherwise
 
         for (pid_t child_pid : child_pids) {
-            wpid = waitpid(child_pid, &status, WUNTRACED | WNOHANG);
+            wpid = wait4(child_pid, &status, WUNTRACED | WNOHANG, &ru);
             
             if (wpid == -1) {
                 if (errno != ECHILD) {  // Ignore if child has already exited
@@ -213,11 +218,19 @@ void run_pipeline(vector<Parsed>& cmds, bool background) {
             if (WIFSTOPPED(status)) {
                 // Job has been stopped (Ctrl+Z): add to jobs as stopped
                 string cmdstr = cmd_str;
-                add_job(pgid, cmdstr, false); // running=false -> stopped
+                add_job(pgid, cmdstr, false, true); // stopped
+                last_status = 128 + WSTOPSIG(status);
                 all_exited = false;
                 break;
             }
 
+            long kb = ru.ru_maxrss;
+#ifdef __APPLE__
+            kb /= 1024; // bytes there, KB on Linux
+#endif
+            if (peak_kb && kb > *peak_kb) *peak_kb = kb;
+            if (child_pid == child_pids.back())
+                last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
             if (WIFEXITED(status)) {
                 if (WEXITSTATUS(status) != 0) {
                     // Command failed, but we don't exit the shell
@@ -241,4 +254,5 @@ void run_pipeline(vector<Parsed>& cmds, bool background) {
 
     // Optionally reap remaining children in that group (non-blocking)
     while ((wpid = waitpid(-pgid, &status, WNOHANG)) > 0) { /*nada*/ }
+    return last_status;
 }
\ No newline at end of file
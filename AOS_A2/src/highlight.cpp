@@ -0,0 +1,153 @@
+#include "highlight.h"
+#include "pathcache.h"
+#include "builtins.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+enum { TOK_WORD, TOK_COMMAND, TOK_REDIRECT, TOK_OPERATOR };
+enum { ST_CMD = 1, ST_AFTER_REDIR = 2 };  // lexer state bits
+
+static bool is_space(char c) { return c == ' ' || c == '\t'; }
+static bool is_op(char c) { return c == '|' || c == ';' || c == '&'; }
+static bool is_redir(char c) { return c == '<' || c == '>'; }
+
+static unsigned char command_style(const char* p, size_t len) {
+    string name(p, len);
+    if (name.find_first_of("'\"$") != string::npos) return STYLE_PLAIN;
+    if (find_builtin(name)) return STYLE_BUILTIN;
+    switch (path_cache_lookup(name)) {
+        case PathLookup::Found:   return STYLE_COMMAND;
+        case PathLookup::Missing: return STYLE_BAD_COMMAND;
+        default:                  return STYLE_PLAIN;
+    }
+}
+
+// Common prefix/suffix lengths, skipping equal blocks with memcmp.
+static size_t common_prefix(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+    while (i + 64 <= n && memcmp(a + i, b + i, 64) == 0) i += 64;
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+static size_t common_suffix(const char* a_end, const char* b_end, size_t n) {
+    size_t i = 0;
+    while (i + 64 <= n && memcmp(a_end - i - 64, b_end - i - 64, 64) == 0) i += 64;
+    while (i < n && *(a_end - i - 1) == *(b_end - i - 1)) ++i;
+    return i;
+}
+
+void Highlighter::paint(const Token& t, const string& line) {
+    unsigned char* s = styles.data() + t.start;
+    const char* p = line.data() + t.start;
+    if (t.kind == TOK_OPERATOR) { memset(s, STYLE_OPERATOR, t.len); return; }
+    if (t.kind == TOK_REDIRECT) { memset(s, STYLE_REDIRECT, t.len); return; }
+    memset(s, t.kind == TOK_COMMAND ? t.style : (unsigned char)STYLE_PLAIN, t.len);
+    char quote = 0;
+    for (size_t i = 0; i < t.len; ++i) {
+        if (quote) {
+            s[i] = STYLE_STRING;
+            if (p[i] == quote) quote = 0;
+        } else if (p[i] == '"' || p[i] == '\'') {
+            quote = p[i];
+            s[i] = STYLE_STRING;
+        }
+    }
+}
+
+const vector<unsigned char>& Highlighter::update(const string& line) {
+    size_t n = min(prev.size(), line.size());
+    size_t pre = common_prefix(prev.data(), line.data(), n);
+
+    if (pre != prev.size() || pre != line.size()) {
+        // Edited region: everything between the common prefix and common suffix
+        size_t suf = common_suffix(prev.data() + prev.size(), line.data() + line.size(), n - pre);
+        size_t changed_end = line.size() - suf;
+        long delta = (long)line.size() - (long)prev.size();
+
+        // Restart at the first token touching the edit
+        size_t k = partition_point(tokens.begin(), tokens.end(),
+                                   [pre](const Token& t) { return t.start + t.len < pre; }) - tokens.begin();
+        size_t restart = k < tokens.size() ? min(tokens[k].start, pre) : (tokens.empty() ? 0 : tokens.back().start + tokens.back().len);
+        unsigned char state = k < tokens.size() ? tokens[k].state : end_state;
+
+        vector<Token> fresh;
+        size_t pos = restart;
+        size_t j = k;  // next old token that could line up again
+        bool synced = false;
+        while (true) {
+            while (pos < line.size() && is_space(line[pos])) ++pos;
+            if (pos >= line.size()) break;
+
+            // Unchanged text lexed from the same state gives the same tokens
+            if (pos >= changed_end) {
+                while (j < tokens.size() && (long)tokens[j].start + delta < (long)pos) ++j;
+                if (j < tokens.size() && (long)tokens[j].start + delta == (long)pos && tokens[j].state == state) {
+                    synced = true;
+                    break;
+                }
+            }
+
+            Token t{pos, 0, TOK_WORD, state, STYLE_PLAIN};
+            char c = line[pos];
+            if (is_op(c)) {
+                t.kind = TOK_OPERATOR;
+                t.len = 1;
+                state = ST_CMD;
+            } else if (is_redir(c)) {
+                t.kind = TOK_REDIRECT;
+                t.len = (c == '>' && pos + 1 < line.size() && line[pos + 1] == '>') ? 2 : 1;
+                state = (state & ST_CMD) | ST_AFTER_REDIR;
+            } else {
+                char quote = 0;
+                size_t e = pos;
+                for (; e < line.size(); ++e) {
+                    char ch = line[e];
+                    if (quote) { if (ch == quote) quote = 0; continue; }
+                    if (ch == '"' || ch == '\'') { quote = ch; continue; }
+                    if (is_space(ch) || is_op(ch) || is_redir(ch)) break;
+                }
+                t.len = e - pos;
+                if (state & ST_AFTER_REDIR) {
+                    state &= ~ST_AFTER_REDIR;  // a file name, the command may still follow
+                } else if (state & ST_CMD) {
+                    t.kind = TOK_COMMAND;
+                    t.style = command_style(line.data() + pos, t.len);
+                    state = 0;
+                }
+            }
+            fresh.push_back(t);
+            pos += t.len;
+        }
+        if (!synced) {
+            j = tokens.size();
+            end_state = state;
+        }
+
+        // Splice: old tokens [k, j) are replaced, the rest only move
+        size_t old_sync = j < tokens.size() ? tokens[j].start : prev.size();
+        size_t new_sync = synced ? (size_t)((long)old_sync + delta) : line.size();
+        tokens.erase(tokens.begin() + k, tokens.begin() + j);
+        tokens.insert(tokens.begin() + k, fresh.begin(), fresh.end());
+        for (size_t i = k + fresh.size(); i < tokens.size(); ++i)
+            tokens[i].start = (size_t)((long)tokens[i].start + delta);
+
+        styles.erase(styles.begin() + restart, styles.begin() + old_sync);
+        styles.insert(styles.begin() + restart, new_sync - restart, STYLE_PLAIN);
+        for (const Token& t : fresh) paint(t, line);
+        prev = line;
+    }
+
+    // Commands lexed before the PATH index was ready are looked up again once
+    if (!path_ready && path_cache_ready()) {
+        path_ready = true;
+        for (Token& t : tokens) {
+            if (t.kind != TOK_COMMAND) continue;
+            t.style = command_style(line.data() + t.start, t.len);
+            paint(t, line);
+        }
+    }
+    return styles;
+}
@@ -1,19 +1,45 @@
 #include "history.h"
+#include "suggest.h"
+#include "utils.h"
+#include "histmeta.h"
 #include <vector>
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <unistd.h>
+#include <limits.h>
 
 static std::vector<std::string> history;
 static const std::string histfile = "/tmp/mysh_history.txt";
 
+// Suggestion indexes: every entry by recency, and per directory by how often
+// it was run there this session. Entries dropped from `history` stay indexed.
+struct DirUse {
+    PrefixIndex index;
+    std::unordered_map<std::string, unsigned long> count;
+};
+static PrefixIndex recent;
+static unsigned long stamp = 0;
+static std::unordered_map<std::string, DirUse> by_dir;
+
 void load_history() {
     history.clear();
     std::ifstream fin(histfile);
     std::string line;
     while (std::getline(fin, line)) {
-        if (!line.empty()) history.push_back(line);
+        if (!line.empty()) {
+            history.push_back(line);
+            recent.insert(line, ++stamp);
+        }
     }
 }
 
@@ -25,6 +51,26 @@ void save_history() {
 void add_history(const std::string& cmd) {
     history.push_back(cmd);
     if (history.size() > 100) history.erase(history.begin());
+
+    recent.insert(cmd, ++stamp);
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd))) {
+        DirUse& d = by_dir[cwd];
+        d.index.insert(cmd, ++d.count[cmd]);
+    }
+}
+
+std::string suggest_history(const std::string& prefix, const std::string& cwd) {
+    if (prefix.empty()) return "";
+    const std::string* hit = nullptr;
+    auto d = by_dir.find(cwd);
+    if (d != by_dir.end()) hit = d->second.index.best(prefix);
+    if (!hit) hit = recent.best(prefix);
+    return hit ? *hit : "";
+}
+
+const std::vector<std::string>& get_history() {
+    return history;
 }
 
 void show_history(int n) {
@@ -33,3 +79,130 @@ void show_history(int n) {
     for (int i = start; i < hist_size; i++)
         std::cout << history[i] << "\n";
 }
+
+// ---------- Sidecar ----------
+// Format and file handling are in histmeta.h.
+static const std::string metafile = "/tmp/mysh_history.meta";
+
+// Index, built once from the sidecar and kept current by history_record().
+struct CmdTimes {
+    std::vector<uint32_t> ms; // sorted, for percentiles
+    uint64_t total_ms = 0;
+    unsigned fails = 0;
+};
+static std::vector<Rec> recs;
+static std::multimap<uint32_t, size_t, std::greater<uint32_t>> by_duration; // slowest first
+static std::vector<size_t> failed;
+static std::unordered_map<std::string, CmdTimes> by_cmd; // first word of the line
+static bool meta_loaded = false;
+
+static void index_rec(size_t i) {
+    const Rec& r = recs[i];
+    by_duration.emplace(r.h.dur_ms, i);
+    if (r.h.status) failed.push_back(i);
+    std::istringstream in(r.cmd);
+    std::string word;
+    in >> word;
+    CmdTimes& c = by_cmd[word];
+    c.ms.insert(std::upper_bound(c.ms.begin(), c.ms.end(), r.h.dur_ms), r.h.dur_ms);
+    c.total_ms += r.h.dur_ms;
+    if (r.h.status) c.fails++;
+}
+
+static void load_meta() {
+    meta_loaded = true;
+    recs = meta_load(metafile);
+    for (size_t i = 0; i < recs.size(); i++) index_rec(i);
+}
+
+void history_record(const std::string& cmd, time_t start, double secs, int status, long peak_kb) {
+    if (!meta_loaded) load_meta();
+    Rec r = meta_rec(cmd, get_cwd(), start, secs, status, peak_kb);
+    meta_append(metafile, r);
+    recs.push_back(std::move(r));
+    index_rec(recs.size() - 1);
+}
+
+// ---------- Queries ----------
+static std::string fmt_ms(uint32_t ms) {
+    char buf[32];
+    if (ms < 60000) snprintf(buf, sizeof(buf), "%.2fs", ms / 1000.0);
+    else if (ms < 3600000) snprintf(buf, sizeof(buf), "%um%02us", ms / 60000, ms / 1000 % 60);
+    else snprintf(buf, sizeof(buf), "%uh%02um", ms / 3600000, ms / 60000 % 60);
+    return buf;
+}
+
+static std::string fmt_kb(uint32_t kb) {
+    char buf[32];
+    if (!kb) return "-";
+    if (kb < 1024) snprintf(buf, sizeof(buf), "%uK", kb);
+    else if (kb < 1024 * 1024) snprintf(buf, sizeof(buf), "%.1fM", kb / 1024.0);
+    else snprintf(buf, sizeof(buf), "%.1fG", kb / (1024.0 * 1024));
+    return buf;
+}
+
+static void print_rec(const Rec& r) {
+    char when[32], line[96];
+    time_t t = r.h.start;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    snprintf(line, sizeof(line), "%s  %8s  %3u  %6s  ", when, fmt_ms(r.h.dur_ms).c_str(), r.h.status,
+             fmt_kb(r.h.rss_kb).c_str());
+    std::cout << line << r.cmd << "  (" << r.cwd << ")\n";
+}
+
+// Nearest rank.
+static uint32_t percentile(const std::vector<uint32_t>& ms, int p) {
+    size_t k = (ms.size() * p + 99) / 100;
+    return ms[k ? k - 1 : 0];
+}
+
+static void print_stats(const std::string& cmd, const CmdTimes& c) {
+    char line[128];
+    snprintf(line, sizeof(line), "%-16s %6zu %9s %9s %9s %9s %6u", cmd.c_str(), c.ms.size(),
+             fmt_ms(percentile(c.ms, 50)).c_str(), fmt_ms(percentile(c.ms, 95)).c_str(), fmt_ms(c.ms.back()).c_str(),
+             fmt_ms((uint32_t)std::min<uint64_t>(c.total_ms, UINT32_MAX)).c_str(), c.fails);
+    std::cout << line << "\n";
+}
+
+bool history_query(char** args) {
+    if (!meta_loaded) load_meta();
+    std::string opt = args[1];
+    bool stats = opt == "--stats";
+    int n = 10;
+    if (!stats && args[2]) {
+        char* end;
+        n = (int)strtol(args[2], &end, 10);
+        if (*end || n <= 0 || args[3]) n = -1;
+    }
+    if ((opt != "--slowest" && opt != "--failed" && !stats) || n < 0) {
+        std::cerr << "usage: history [N | --slowest [N] | --failed [N] | --stats [CMD...]]\n";
+        return false;
+    }
+    if (stats) {
+        std::cout << "command            runs       p50       p95       max     total failed\n";
+        if (args[2]) {
+            for (int i = 2; args[i]; i++) {
+                auto it = by_cmd.find(args[i]);
+                if (it == by_cmd.end()) std::cerr << "history: " << args[i] << ": not in history\n";
+                else print_stats(it->first, it->second);
+            }
+            return true;
+        }
+        // The commands that took the most time overall.
+        std::vector<const std::pair<const std::string, CmdTimes>*> top;
+        for (auto& kv : by_cmd) top.push_back(&kv);
+        size_t k = std::min<size_t>(top.size(), 15);
+        std::partial_sort(top.begin(), top.begin() + k, top.end(),
+                          [](auto* a, auto* b) { return a->second.total_ms > b->second.total_ms; });
+        for (size_t i = 0; i < k; i++) print_stats(top[i]->first, top[i]->second);
+        return true;
+    }
+    std::cout << "started              duration  st    peak  command (cwd)\n";
+    if (opt == "--slowest") {
+        for (auto it = by_duration.begin(); it != by_duration.end() && n-- > 0; ++it) print_rec(recs[it->second]);
+        return true;
+    }
+    size_t from = failed.size() > (size_t)n ? failed.size() - n : 0;
+    for (size_t i = from; i < failed.size(); i++) print_rec(recs[failed[i]]);
+    return true;
+}
@@ -1,138 +1,486 @@
 #include "input.h"
 #include "history.h"
+#include "highlight.h"
+#include "signals.h"
+#include "jobs.h"
 #include <iostream>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <limits.h>
 #include <cstring>
+#include <cerrno>
+#include <cwchar>
+#include <csignal>
+#include <string>
 #include <vector>
+#include <algorithm>
 
 static struct termios orig_termios;  // Save original terminal settings
-static std::vector<std::string> history;
-static size_t history_index = 0;
-static std::string current_input;
-static bool history_navigation = false;
 
 void setup_raw_mode() {
     tcgetattr(STDIN_FILENO, &orig_termios);
     struct termios raw = orig_termios;
     raw.c_lflag &= ~(ICANON | ECHO);  // Disable canonical mode and echo
-    raw.c_cc[VMIN] = 1;  // Read one character at a time
+    raw.c_cc[VMIN] = 1;  // Block until at least one byte is available
     raw.c_cc[VTIME] = 0;  // No timeout
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    write(STDOUT_FILENO, "\033[?2004h", 8);  // have the terminal bracket pastes
 }
 
 void restore_terminal() {
+    write(STDOUT_FILENO, "\033[?2004l", 8);
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
 }
 
-static void clear_line() {
-    std::cout << "\r\033[K";  // Clear line from cursor to end
-    std::cout.flush();
+// ---------- Buffered input ----------
+// Keystrokes are read in bulk and consumed from this buffer; the screen is
+// only updated once the buffer has been drained.
+static char inbuf[4096];
+static size_t in_pos = 0, in_len = 0;
+
+static bool input_pending() { return in_pos < in_len; }
+
+static bool next_byte(char& c) {
+    if (in_pos == in_len) {
+        ssize_t n;
+        while ((n = read(STDIN_FILENO, inbuf, sizeof(inbuf))) < 0 && errno == EINTR) {}
+        if (n <= 0) return false;
+        in_pos = 0;
+        in_len = (size_t)n;
+    }
+    c = inbuf[in_pos++];
+    return true;
 }
 
-static void refresh_line(const std::string& prompt, const std::string& line) {
-    clear_line();
-    std::cout << prompt << line;
-    std::cout.flush();
+// The rest of an escape sequence arrives with its ESC; a byte that doesn't
+// come within ESC_WAIT_MS means the ESC key was pressed on its own.
+static const int ESC_WAIT_MS = 25;
+
+static bool next_byte_within(char& c, int ms) {
+    if (!input_pending()) {
+        struct pollfd p = {STDIN_FILENO, POLLIN, 0};
+        int r;
+        while ((r = poll(&p, 1, ms)) < 0 && errno == EINTR) {}
+        if (r <= 0) return false;
+    }
+    return next_byte(c);
 }
 
-std::string read_line_with_history() {
-    const std::string prompt = "mysh> ";  // You might want to get this from your prompt module
-    std::string line;
-    char c;
-    bool reading = true;
-    int escape_seq = 0;
-    char escape_buffer[3] = {0};
+// Waits for the terminal or a signal; signals are handled here, in normal
+// context, and returned in sigs. True once stdin is readable.
+static bool wait_for_input(std::vector<int>& sigs) {
+    struct pollfd p[2] = {{STDIN_FILENO, POLLIN, 0}, {signal_fd(), POLLIN, 0}};
+    int r;
+    while ((r = poll(p, signal_fd() >= 0 ? 2 : 1, -1)) < 0 && errno == EINTR) {}
+    if (r > 0 && (p[1].revents & POLLIN)) sigs = handle_signals();
+    return r < 0 || p[0].revents;  // on a poll error let read() report it
+}
+
+// Bracketed paste: everything up to ESC[201~ is taken straight out of the
+// input buffer in blocks, with no per-character decoding or rendering.
+static const char PASTE_END[] = "\033[201~";
+static const size_t PASTE_END_LEN = sizeof(PASTE_END) - 1;
 
-    // Initialize or reset state
-    if (!history_navigation) {
-        current_input = "";
-        history_index = history.size();
+static std::string read_paste() {
+    std::string text;
+    while (true) {
+        if (in_pos == in_len) {
+            char c;
+            if (!next_byte(c)) break;
+            --in_pos;
+        }
+        size_t scan_from = text.size() >= PASTE_END_LEN ? text.size() - (PASTE_END_LEN - 1) : 0;
+        text.append(inbuf + in_pos, in_len - in_pos);
+        in_pos = in_len;
+        size_t end = text.find(PASTE_END, scan_from);
+        if (end != std::string::npos) {
+            in_pos = in_len - (text.size() - end - PASTE_END_LEN);  // hand back what follows
+            text.resize(end);
+            break;
+        }
     }
+    for (char& ch : text)
+        if (ch == '\r') ch = '\n';
+    return text;
+}
 
-    std::cout << prompt;
-    std::cout.flush();
+// ---------- Renderer ----------
+// Keeps a model of what is on screen after the prompt and turns each update
+// into the smallest escape-sequence diff, sent with a single write().
+struct Cell {
+    std::string ch;       // bytes of one character
+    unsigned char width;  // columns it takes: 0, 1 or 2
+    unsigned char style;
+    bool operator==(const Cell& o) const { return ch == o.ch && style == o.style; }
+};
 
-    while (reading && read(STDIN_FILENO, &c, 1) == 1) {
-        if (escape_seq > 0) {
-            escape_buffer[escape_seq - 1] = c;
-            escape_seq++;
+// Length in bytes of the character at s[i] and its width in columns (-1
+// when it isn't printable, or doesn't decode in the current locale).
+static size_t char_at(const std::string& s, size_t i, int& width) {
+    std::mbstate_t st{};
+    wchar_t wc;
+    size_t n = std::mbrtowc(&wc, s.data() + i, s.size() - i, &st);
+    if (n == 0 || n == (size_t)-1 || n == (size_t)-2) {
+        width = -1;
+        return 1;
+    }
+    width = wcwidth(wc);
+    return n;
+}
 
-            if (escape_seq == 3) {
-                escape_seq = 0;
-                if (escape_buffer[0] == '[') {
-                    if (escape_buffer[1] == 'A') {  // Up arrow
-                        if (history_index > 0) {
-                            if (!history_navigation) {
-                                current_input = line;  // Save current input first time
-                                history_navigation = true;
-                            }
-                            history_index--;
-                            line = history[history_index];
-                            refresh_line(prompt, line);
-                        }
-                    }
-                    else if (escape_buffer[1] == 'B') {  // Down arrow
-                        if (history_navigation) {
-                            if (history_index < history.size() - 1) {
-                                history_index++;
-                                line = history[history_index];
-                            }
-                            else {
-                                history_index = history.size();
-                                line = current_input;
-                                history_navigation = false;
-                            }
-                            refresh_line(prompt, line);
-                        }
-                    }
-                }
-            }
+static const char* style_sgr(unsigned char style) {
+    switch (style) {
+        case STYLE_CONTROL:     return "\033[0;7m";
+        case STYLE_BUILTIN:     return "\033[0;1;36m";
+        case STYLE_COMMAND:     return "\033[0;1;32m";
+        case STYLE_BAD_COMMAND: return "\033[0;1;31m";
+        case STYLE_STRING:      return "\033[0;33m";
+        case STYLE_REDIRECT:    return "\033[0;35m";
+        case STYLE_OPERATOR:    return "\033[0;1;35m";
+        case STYLE_SUGGEST:     return "\033[0;90m";
+        default: return "\033[0m";
+    }
+}
+
+// Visible columns of a string, skipping ANSI escape sequences.
+static size_t visible_width(const std::string& s) {
+    size_t w = 0;
+    for (size_t i = 0, n; i < s.size(); i += n) {
+        if (s[i] == '\033' && i + 1 < s.size() && s[i + 1] == '[') {
+            i += 2;
+            while (i < s.size() && !(s[i] >= '@' && s[i] <= '~')) ++i;
+            n = 1;
             continue;
         }
+        int cw;
+        n = char_at(s, i, cw);
+        w += cw < 0 ? 1 : cw;
+    }
+    return w;
+}
+
+class LineRenderer {
+public:
+    void begin(const std::string& prompt) {
+        this->prompt = prompt;
+        prompt_cols = visible_width(prompt);
+        query_cols();
+        shown.clear();
+        out = prompt;
+        pos = prompt_cols;
+        if (pos > 0 && pos % cols == 0) out += "\r\n";
+        flush();
+    }
 
-        switch (c) {
-            case '\x1b':  // ESC character
-                escape_seq = 1;
-                break;
-
-            case '\n':    // Enter
-            case '\r':
-                std::cout << "\n";
-                reading = false;
-                history_navigation = false;
-                break;
-
-            case 127:    // Backspace
-            case '\b':
-                if (!line.empty()) {
-                    line.pop_back();
-                    refresh_line(prompt, line);
+    // cursor is a cell index.
+    void render(const std::vector<Cell>& cells, size_t cursor) {
+        size_t d = 0;
+        while (d < cells.size() && d < shown.size() && cells[d] == shown[d]) ++d;
+
+        if (d < cells.size() || d < shown.size()) {
+            size_t old_end = col_after(shown, shown.size());
+            size_t col = col_after(cells, d);
+            move_to(col);
+            unsigned char cur_style = 0;
+            for (size_t i = d; i < cells.size(); ++i) {
+                if (cells[i].style != cur_style) {
+                    out += style_sgr(cells[i].style);
+                    cur_style = cells[i].style;
                 }
-                break;
-
-            case 3:     // Ctrl-C
-                std::cout << "^C\n";
-                line.clear();
-                reading = false;
-                break;
-
-            case 4:     // Ctrl-D
-                if (line.empty()) {
-                    std::cout << "\n";
-                    return "exit";
+                if (cells[i].width == 2 && col % cols == cols - 1) {  // a wide character starts the next row
+                    out += ' ';
+                    ++col;
                 }
-                break;
+                out += cells[i].ch;
+                col += cells[i].width;
+            }
+            if (cur_style != 0) out += style_sgr(0);
+            pos = col;
+            if (cells.size() > d && pos % cols == 0) out += "\r\n"; // leave the pending-wrap state
+            if (old_end > pos) out += "\033[J";
+            shown = cells;
+        }
+        move_to(col_after(shown, cursor));
+        flush();
+    }
+
+    // Print text where the prompt is and put the prompt back below it; the
+    // caller re-renders the line.
+    void print_above(const std::string& text) {
+        move_to(0);
+        out += "\r\033[J" + text;
+        reprint_prompt();
+    }
+
+    // After SIGWINCH: clear from the prompt down (still addressed with the
+    // old width), take the new width and redraw the prompt; the caller
+    // re-renders the line from its model.
+    void resize() {
+        move_to(0);
+        out += "\r\033[J";
+        query_cols();
+        reprint_prompt();
+    }
+
+    // Park the cursor after the line and start a fresh one.
+    void finish() {
+        move_to(col_after(shown, shown.size()));
+        out += "\n";
+        flush();
+    }
 
-            default:
-                if (!iscntrl(c)) {  // Only add printable characters
-                    line += c;
-                    std::cout << c;
-                    std::cout.flush();
+private:
+    std::vector<Cell> shown;   // cells currently on screen after the prompt
+    std::string prompt;
+    size_t prompt_cols = 0;
+    size_t pos = 0;            // cursor, as a column offset from the prompt start
+    size_t cols = 80;
+    std::string out;
+
+    void query_cols() {
+        struct winsize ws;
+        cols = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) ? ws.ws_col : 80;
+    }
+
+    void reprint_prompt() {
+        out += prompt;
+        shown.clear();
+        pos = prompt_cols;
+        if (pos > 0 && pos % cols == 0) out += "\r\n";
+        flush();
+    }
+
+    // Column offset just after the first n cells, as render() lays them out.
+    size_t col_after(const std::vector<Cell>& cells, size_t n) const {
+        size_t col = prompt_cols;
+        for (size_t i = 0; i < n && i < cells.size(); ++i) {
+            if (cells[i].width == 2 && col % cols == cols - 1) ++col;
+            col += cells[i].width;
+        }
+        return col;
+    }
+
+    void move_to(size_t target) {
+        if (target == pos) return;
+        size_t r0 = pos / cols, r1 = target / cols;
+        size_t c0 = pos % cols, c1 = target % cols;
+        if (r1 < r0) out += "\033[" + std::to_string(r0 - r1) + "A";
+        else if (r1 > r0) out += "\033[" + std::to_string(r1 - r0) + "B";
+        if (c1 + 1 == c0) out += "\b";
+        else if (c1 < c0) out += "\033[" + std::to_string(c0 - c1) + "D";
+        else if (c1 > c0) out += "\033[" + std::to_string(c1 - c0) + "C";
+        pos = target;
+    }
+
+    void flush() {
+        size_t off = 0;
+        while (off < out.size()) {
+            ssize_t w = write(STDOUT_FILENO, out.data() + off, out.size() - off);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            off += (size_t)w;
+        }
+        out.clear();
+    }
+};
+
+// ---------- Line editor ----------
+// One cell per character. cursor_cell, if given, gets the index of the
+// cell at byte offset cursor.
+static std::vector<Cell> to_cells(Highlighter& hl, const std::string& line, size_t cursor = 0,
+                                  size_t* cursor_cell = nullptr) {
+    const std::vector<unsigned char>& styles = hl.update(line);
+    std::vector<Cell> cells;
+    cells.reserve(line.size());
+    if (cursor_cell) *cursor_cell = 0;
+    for (size_t i = 0, n; i < line.size(); i += n) {
+        if (cursor_cell && i < cursor) *cursor_cell = cells.size() + 1;
+        unsigned char ch = line[i];
+        int w;
+        n = char_at(line, i, w);
+        if (iscntrl(ch)) cells.push_back({std::string(1, (char)((ch + 64) & 0x7f)), 1, STYLE_CONTROL});  // pasted tab etc.
+        else if (w < 0) cells.push_back({"?", 1, STYLE_CONTROL});
+        else cells.push_back({line.substr(i, n), (unsigned char)w, styles[i]});
+    }
+    return cells;
+}
+
+// Byte offsets of the characters before and after position i.
+static size_t prev_char(const std::string& s, size_t i) {
+    while (i > 0 && (s[--i] & 0xC0) == 0x80) {}
+    return i;
+}
+
+static size_t next_char(const std::string& s, size_t i) {
+    int w;
+    return std::min(s.size(), i + char_at(s, i, w));
+}
+
+static std::string carry;  // unfinished last line of a multi-line paste
+
+static void write_all(const std::string& s) {
+    size_t off = 0;
+    while (off < s.size()) {
+        ssize_t w = write(STDOUT_FILENO, s.data() + off, s.size() - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        off += (size_t)w;
+    }
+}
+
+std::string read_line_with_history(const std::string& prompt) {
+    const std::vector<std::string>& history = get_history();
+    size_t history_index = history.size();
+    std::string saved_input;  // what was typed before browsing history
+    std::string line;
+    size_t cursor = 0;
+    LineRenderer screen;
+    Highlighter hl;
+    std::string suggestion;  // greyed-out rest of a history entry, shown at the end of the line
+    char cwd[PATH_MAX];
+    std::string dir = getcwd(cwd, sizeof(cwd)) ? cwd : "";
+
+    auto redraw = [&]() {
+        size_t cursor_cell;
+        std::vector<Cell> cells = to_cells(hl, line, cursor, &cursor_cell);
+        suggestion.clear();
+        if (cursor == line.size()) {
+            std::string s = suggest_history(line, dir);
+            if (s.size() > line.size()) suggestion = s.substr(line.size());
+        }
+        for (size_t i = 0, n; i < suggestion.size(); i += n) {
+            int w;
+            n = char_at(suggestion, i, w);
+            if (w >= 0) cells.push_back({suggestion.substr(i, n), (unsigned char)w, STYLE_SUGGEST});
+        }
+        screen.render(cells, cursor_cell);
+    };
+    auto accept_or_end = [&]() {
+        if (cursor == line.size()) line += suggestion;
+        cursor = line.size();
+    };
+
+    std::cout.flush();
+    screen.begin(prompt);
+    line.swap(carry);
+    cursor = line.size();
+    if (!line.empty()) redraw();
+
+    char c;
+    while (true) {
+        bool interrupted = false;
+        if (!input_pending()) {
+            std::vector<int> sigs;
+            bool readable = wait_for_input(sigs);
+            interrupted = std::find(sigs.begin(), sigs.end(), SIGINT) != sigs.end();
+            bool resized = std::find(sigs.begin(), sigs.end(), SIGWINCH) != sigs.end();
+            std::string done = job_notices();
+            if (resized) screen.resize();
+            if (!done.empty()) screen.print_above(done);
+            if (resized || !done.empty()) redraw();
+            if (!readable && !interrupted) continue;
+        }
+        if (interrupted) c = 3;  // ^C arrives as SIGINT while ISIG is on
+        else if (!next_byte(c)) break;
+
+        if (c == '\x1b') {  // ESC [ params final, ESC O x
+            char s1, t;
+            if (!next_byte_within(s1, ESC_WAIT_MS) || !next_byte_within(t, ESC_WAIT_MS)) continue;  // lone ESC
+            std::string params;
+            if (s1 == '[') {
+                while (t >= '0' && t <= '?') {
+                    params += t;
+                    if (!next_byte_within(t, ESC_WAIT_MS)) break;
                 }
-                break;
+            } else if (s1 != 'O') {
+                continue;
+            }
+            if (t == '~') {
+                if (params == "200") {  // start of a bracketed paste
+                    std::string text = read_paste();
+                    size_t nl = text.rfind('\n');
+                    if (nl == std::string::npos) {
+                        line.insert(cursor, text);
+                        cursor += text.size();
+                    } else {
+                        // Whole lines run as a batch; the tail waits at the next prompt
+                        std::string batch = line.substr(0, cursor) + text.substr(0, nl);
+                        carry = text.substr(nl + 1) + line.substr(cursor);
+                        size_t first = batch.find('\n');
+                        std::vector<Cell> head = to_cells(hl, batch.substr(0, first));
+                        screen.render(head, head.size());
+                        screen.finish();
+                        if (first != std::string::npos) write_all(batch.substr(first + 1) + "\n");
+                        return batch;
+                    }
+                } else if (params == "3" && cursor < line.size()) {
+                    line.erase(cursor, next_char(line, cursor) - cursor);  // Delete
+                } else if (params == "1" || params == "7") {
+                    cursor = 0;
+                } else if (params == "4" || params == "8") {
+                    accept_or_end();
+                }
+            } else {
+                switch (t) {
+                    case 'A':  // Up arrow
+                        if (history_index > 0) {
+                            if (history_index == history.size()) saved_input = line;
+                            line = history[--history_index];
+                            cursor = line.size();
+                        }
+                        break;
+                    case 'B':  // Down arrow
+                        if (history_index < history.size()) {
+                            ++history_index;
+                            line = (history_index == history.size()) ? saved_input : history[history_index];
+                            cursor = line.size();
+                        }
+                        break;
+                    case 'C':  // Right; at the end it takes the suggestion
+                        if (cursor < line.size()) cursor = next_char(line, cursor);
+                        else accept_or_end();
+                        break;
+                    case 'D': cursor = prev_char(line, cursor); break;    // Left
+                    case 'H': cursor = 0; break;                          // Home
+                    case 'F': accept_or_end(); break;                     // End
+                }
+            }
+        } else if (c == '\n' || c == '\r') {  // Enter
+            std::vector<Cell> cells = to_cells(hl, line);
+            screen.render(cells, cells.size());
+            screen.finish();
+            return line;
+        } else if (c == 127 || c == '\b') {  // Backspace
+            size_t from = prev_char(line, cursor);
+            line.erase(from, cursor - from);
+            cursor = from;
+        } else if (c == 1) {  // Ctrl-A
+            cursor = 0;
+        } else if (c == 5) {  // Ctrl-E
+            accept_or_end();
+        } else if (c == 21) {  // Ctrl-U
+            line.erase(0, cursor);
+            cursor = 0;
+        } else if (c == 3) {  // Ctrl-C
+            size_t cursor_cell;
+            std::vector<Cell> cells = to_cells(hl, line, cursor, &cursor_cell);
+            screen.render(cells, cursor_cell);
+            std::cout << "^C\n";
+            std::cout.flush();
+            return "";
+        } else if (c == 4) {  // Ctrl-D
+            if (line.empty()) {
+                screen.finish();
+                return "exit";
+            }
+        } else if (!iscntrl((unsigned char)c)) {  // Only add printable characters
+            line.insert(cursor++, 1, c);
         }
+
+        if (!input_pending()) redraw();
     }
 
-    return line;
+    return line.empty() ? "exit" : line;  // EOF
 }
@@ -2,22 +2,29 @@
 #include <signal.h>
 #include <unistd.h>
 #include <iostream>
+#include <cstdio>
 #include <cstdlib>   // for system()
 #include <sys/wait.h>
 #include <termios.h>
+#include <cerrno>
+#include <algorithm>
 
 using namespace std;
 
 vector<Job> jobs;
 int next_job_id = 1;
 
-void add_job(pid_t pid, const string& cmd, bool running, bool stopped) {
+void add_job(pid_t pid, const string& cmd, bool running, bool stopped, pid_t last_pid) {
     Job j;
     j.job_id = next_job_id++;
     j.pid = pid;
     j.cmd = cmd;       
     j.running = running;
     j.stopped = stopped;
+    j.done = false;
+    j.last_pid = last_pid ? last_pid : pid;
+    j.status = 0;
+    j.started = chrono::steady_clock::now();
     jobs.push_back(j);
 }
 
@@ -26,15 +33,18 @@ void remove_job(pid_t pid) {
         [pid](const Job& j){ return j.pid == pid; }), jobs.end());
 }
 
+// Reaps every process in each job's group (the job pid is the pgid); a job
+// is finished once its group has no children left, and stays listed until
+// job_notices() has reported it.
 void refresh_jobs() {
     for (auto& j : jobs) {
+        if (j.done) continue;
         int status;
-        pid_t result = waitpid(j.pid, &status, WNOHANG | WUNTRACED | WCONTINUED);
-
-        if (result > 0) {
+        pid_t result;
+        while ((result = waitpid(-j.pid, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
             if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                j.running = false;
-                j.stopped = false;
+                if (result == j.last_pid)
+                    j.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
             } else if (WIFSTOPPED(status)) {
                 j.running = false;
                 j.stopped = true;
@@ -43,12 +53,28 @@ void refresh_jobs() {
                 j.stopped = false;
             }
         }
+        if (result < 0 && errno == ECHILD) {
+            j.running = false;
+            j.stopped = false;
+            j.done = true;
+            j.ended = chrono::steady_clock::now();
+        }
     }
+}
 
-    // Remove finished jobs
+string job_notices() {
+    string out;
+    for (auto& j : jobs) {
+        if (!j.done) continue;
+        char tail[64];
+        snprintf(tail, sizeof(tail), " (status %d, %.2fs)\n", j.status,
+                 chrono::duration<double>(j.ended - j.started).count());
+        out += "[" + to_string(j.job_id) + "] Done    " + j.cmd + tail;
+    }
     jobs.erase(remove_if(jobs.begin(), jobs.end(),
-        [](const Job& j){ return !j.running && !j.stopped; }),
+        [](const Job& j){ return j.done; }),
         jobs.end());
+    return out;
 }
 
 void list_jobs(bool verbose) {
@@ -66,6 +92,11 @@ void list_jobs(bool verbose) {
              << (j.running ? "Running " : (j.stopped ? "Stopped " : "Done "))
              << display_cmd << " [" << j.pid << "]" << endl;
     }
+
+    // Done jobs listed here have been reported
+    jobs.erase(remove_if(jobs.begin(), jobs.end(),
+        [](const Job& j){ return j.done; }),
+        jobs.end());
 }
 
 void fg(int job_id) {
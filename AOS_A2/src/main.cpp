@@ -7,10 +7,16 @@
 #include "jobs.h"
 #include "signals.h"
 #include "utils.h"
+#include "input.h"
+#include "pathcache.h"
 
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <clocale>
+#include <ctime>
 #include <vector>
+#include <deque>
 #include <unistd.h>
 #include <termios.h>
 #include <string.h>
@@ -55,14 +61,46 @@ int main(int argc, char* argv[]) {
     load_history();
     init_signal_handlers();
 
-    while (true) {
-        print_prompt();
+    // On a terminal use the raw-mode line editor; otherwise plain getline
+    bool interactive = isatty(STDIN_FILENO);
+    if (interactive) {
+        path_cache_start();        // command names for highlighting
+        setlocale(LC_CTYPE, "");   // the line editor sizes characters with wcwidth()
+    }
+    deque<string> pending;  // remaining lines of a pasted batch
 
+    while (true) {
+        handle_signals();  // reap jobs that finished while a command ran
+        cout << job_notices();
         string line;
-        if (!getline(cin, line)) break;  // Ctrl+D exits
+        if (!pending.empty()) {
+            line = pending.front();
+            pending.pop_front();
+        } else if (interactive) {
+            setup_raw_mode();
+            line = read_line_with_history(build_prompt());
+            restore_terminal();
+            // A multi-line paste comes back whole; run it line by line like a script
+            size_t nl = line.find('\n');
+            if (nl != string::npos) {
+                for (size_t i = nl + 1, j; i <= line.size(); i = j + 1) {
+                    j = line.find('\n', i);
+                    if (j == string::npos) j = line.size();
+                    pending.push_back(line.substr(i, j - i));
+                }
+                line.resize(nl);
+            }
+        } else {
+            print_prompt();
+            if (!getline(cin, line)) break;  // Ctrl+D exits
+        }
         if (line.empty()) continue;
 
         add_history(line);
+        time_t started = time(nullptr);
+        auto t0 = chrono::steady_clock::now();
+        int status = 0;
+        long peak_kb = 0;
 
         // Split by semicolons into separate commands
         vector<string> commands = split_semicolons(line);
@@ -90,49 +128,9 @@ int main(int argc, char* argv[]) {
             // Identify the command name
             string cmd_name = parsed_stages[0].argv[0] ? parsed_stages[0].argv[0] : "";
 
-            // Builtin commands present in builtins.cpp
-            if (cmd_name == "cd") builtin_cd(parsed_stages[0].argv.data());
-            else if (cmd_name == "pwd") builtin_pwd();
-            else if (cmd_name == "echo") builtin_echo(parsed_stages[0].argv.data());
-            else if (cmd_name == "ls") {
-                builtin_ls(parsed_stages[0].argv.data());
-            }
-            else if (cmd_name == "search") {
-                builtin_search(parsed_stages[0].argv.data());
-            }
-            //pinfo in pinfo.cpp
-            else if (cmd_name == "pinfo") {
-                pid_t pid = parsed_stages[0].argv[1] ? stoi(parsed_stages[0].argv[1]) : 0;
-                pinfo(pid);
-            } 
-            //else if (cmd_name == "search") builtin_search(parsed_stages[0].argv.data());
-            //show_history in history.cpp
-            else if (cmd_name == "history") {
-                int n = 10;
-                if (parsed_stages[0].argv[1]) 
-                    n = stoi(parsed_stages[0].argv[1]);
-                show_history(n);
-            }
-            // Job control builtins in jobs.cpp
-            else if (cmd_name == "jobs") {
-                bool verbose = false;
-                if (parsed_stages[0].argv[1] && string(parsed_stages[0].argv[1]) == "-v") {
-                    verbose = true;
-                }
-                list_jobs(verbose);
-            }
-            else if (cmd_name == "fg" && parsed_stages[0].argv[1]) {
-                if (parsed_stages[0].argv[1])
-                    fg(stoi(parsed_stages[0].argv[1]));
-            }
-             else if (cmd_name == "bg" && parsed_stages[0].argv[1]) {
-                if (parsed_stages[0].argv[1])
-                    bg(stoi(parsed_stages[0].argv[1]));
-            }
-            else if (cmd_name == "sig" && parsed_stages[0].argv[1] && parsed_stages[0].argv[2]) {
-                if (parsed_stages[0].argv[1] && parsed_stages[0].argv[2])
-                    send_sig(stoi(parsed_stages[0].argv[1]), stoi(parsed_stages[0].argv[2]));
-            }
+            // Builtin commands, from the registry in builtins.cpp
+            const Builtin* bi = find_builtin(cmd_name);
+            if (bi && bi->fn) status = bi->fn(parsed_stages[0].argv.data());
             // Exit
             else if (cmd_name == "exit" || cmd_name == "quit") {
                 kill_all_jobs(); //kill_all_jobs in jobs.cpp
@@ -146,7 +144,9 @@ int main(int argc, char* argv[]) {
             }
             // External command
             else {
-                run_pipeline(parsed_stages, background); // run_pipeline in exec.cpp
+                long kb;
+                status = run_pipeline(parsed_stages, background, &kb); // run_pipeline in exec.cpp
+                peak_kb = max(peak_kb, kb);
             }
         }
 
@@ -155,6 +155,8 @@ int main(int argc, char* argv[]) {
                 free_parsed(ps);
             }
         }
+        history_record(line, started, chrono::duration<double>(chrono::steady_clock::now() - t0).count(), status,
+                       peak_kb);
     }
 
     save_history();
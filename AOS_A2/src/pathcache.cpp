@@ -0,0 +1,52 @@
+#include "pathcache.h"
+#include <atomic>
+#include <thread>
+#include <string>
+#include <unordered_set>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+static std::unordered_set<std::string>* path_index = nullptr;  // published once, then read-only
+static std::atomic<bool> path_ready(false);
+
+static void build_index(std::string path) {
+    auto* index = new std::unordered_set<std::string>;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t colon = path.find(':', start);
+        if (colon == std::string::npos) colon = path.size();
+        std::string dir = path.substr(start, colon - start);
+        if (dir.empty()) dir = ".";
+        start = colon + 1;
+
+        DIR* d = opendir(dir.c_str());
+        if (!d) continue;
+        struct dirent* e;
+        while ((e = readdir(d))) {
+            if (e->d_name[0] == '.') continue;
+            if (e->d_type == DT_DIR) continue;
+            if (index->count(e->d_name)) continue;
+            std::string full = dir + "/" + e->d_name;
+            if (access(full.c_str(), X_OK) == 0) index->insert(e->d_name);
+        }
+        closedir(d);
+    }
+    path_index = index;
+    path_ready.store(true, std::memory_order_release);
+}
+
+void path_cache_start() {
+    const char* p = getenv("PATH");
+    std::thread(build_index, std::string(p ? p : "/usr/bin:/bin")).detach();
+}
+
+bool path_cache_ready() {
+    return path_ready.load(std::memory_order_acquire);
+}
+
+PathLookup path_cache_lookup(const std::string& name) {
+    if (name.find('/') != std::string::npos) return PathLookup::Unknown;  // would need a stat
+    if (!path_ready.load(std::memory_order_acquire)) return PathLookup::Unknown;
+    return path_index->count(name) ? PathLookup::Found : PathLookup::Missing;
+}
@@ -15,7 +15,7 @@ extern string g_home;
 #define COLOR_PATH   "\033[1;36m"   // cyan
 #define COLOR_RESET  "\033[0m"
 
-void print_prompt() {
+string build_prompt() {
     // Get username
     const char* username = getenv("USER");
     if (!username) {
@@ -40,12 +40,16 @@ void print_prompt() {
         cwd_str.replace(0, g_home.size(), "~");
     }
 
-    // Print colorized prompt
-    cout << COLOR_USER << username 
-         << "_@_" 
-         << COLOR_HOST << hostname 
-         << ":" 
-         << COLOR_PATH << cwd_str 
-         << COLOR_RESET << "> ";
+    // Colorized prompt
+    return string(COLOR_USER) + username
+         + "_@_"
+         + COLOR_HOST + hostname
+         + ":"
+         + COLOR_PATH + cwd_str
+         + COLOR_RESET + "> ";
+}
+
+void print_prompt() {
+    cout << build_prompt();
     cout.flush();
 }
\ No newline at end of file
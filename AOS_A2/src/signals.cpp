@@ -1,38 +1,63 @@
 #include "signals.h"
 #include "jobs.h"
 #include <csignal>
+#include <cerrno>
+#include <algorithm>
 #include <iostream>
-#include <sys/wait.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 pid_t fg_pid = -1;
 std::string fg_cmd = "";
 
-static void sigint_handler(int) {
-    if (fg_pid > 0) kill(fg_pid, SIGINT);
-    else std::cout << "\n";
-}
+// Self-pipe: the handler only writes the signal number, so nothing that
+// isn't async-signal-safe runs in a handler. handle_signals() does the work.
+static int sig_pipe[2] = {-1, -1};
+static const int shell_signals[] = {SIGINT, SIGTSTP, SIGCHLD, SIGWINCH};
 
-static void sigtstp_handler(int) {
-    if (fg_pid > 0) {
-        kill(fg_pid, SIGTSTP);
-        add_job(fg_pid, fg_cmd, false);
-        std::cout << "\n[" << fg_pid << "] Stopped " << fg_cmd << "\n";
-        fg_pid = -1;
-        fg_cmd.clear();
-    } else std::cout << "\n";
+static void forward_to_pipe(int signo) {
+    int saved = errno;
+    unsigned char b = (unsigned char)signo;
+    (void)!write(sig_pipe[1], &b, 1);  // a full pipe already has a wakeup queued
+    errno = saved;
 }
 
-static void sigchld_handler(int) {
-    int status;
-    pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        remove_job(pid);
+void init_signal_handlers() {
+    if (pipe(sig_pipe) < 0) {
+        perror("pipe");
+        return;
     }
+    for (int fd : sig_pipe) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    struct sigaction sa = {};
+    sa.sa_handler = forward_to_pipe;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    for (int s : shell_signals) sigaction(s, &sa, nullptr);
 }
 
-void init_signal_handlers() {
-    signal(SIGINT, sigint_handler);
-    signal(SIGTSTP, sigtstp_handler);
-    signal(SIGCHLD, sigchld_handler);
-}
\ No newline at end of file
+int signal_fd() { return sig_pipe[0]; }
+
+std::vector<int> handle_signals() {
+    std::vector<int> sigs;
+    unsigned char b;
+    while (sig_pipe[0] >= 0 && read(sig_pipe[0], &b, 1) == 1) {
+        if (std::find(sigs.begin(), sigs.end(), b) == sigs.end()) sigs.push_back(b);
+    }
+    for (int s : sigs) {
+        if (s == SIGCHLD) {
+            refresh_jobs();
+        } else if (s == SIGINT) {
+            if (fg_pid > 0) kill(fg_pid, SIGINT);
+        } else if (s == SIGTSTP && fg_pid > 0) {
+            kill(fg_pid, SIGTSTP);
+            add_job(fg_pid, fg_cmd, false, true);
+            std::cout << "\n[" << fg_pid << "] Stopped " << fg_cmd << "\n";
+            fg_pid = -1;
+            fg_cmd.clear();
+        }
+    }
+    return sigs;
+}
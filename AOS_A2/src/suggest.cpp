@@ -0,0 +1,43 @@
+#include "suggest.h"
+
+using namespace std;
+
+void PrefixIndex::insert(const string& entry, unsigned long rank) {
+    auto found = ids.find(entry);
+    int id;
+    if (found == ids.end()) {
+        id = (int)entries.size();
+        entries.push_back(entry);
+        ids[entry] = id;
+    } else {
+        id = found->second;
+    }
+
+    int n = 0;
+    for (size_t i = 0;; ++i) {
+        if (rank >= nodes[n].rank) {
+            nodes[n].best = id;
+            nodes[n].rank = rank;
+        }
+        if (i == entry.size()) break;
+        auto it = nodes[n].next.find(entry[i]);
+        if (it != nodes[n].next.end()) {
+            n = it->second;
+        } else {
+            int child = (int)nodes.size();
+            nodes[n].next[entry[i]] = child;  // may not hold a reference across the push
+            nodes.emplace_back();
+            n = child;
+        }
+    }
+}
+
+const string* PrefixIndex::best(const string& prefix) const {
+    int n = 0;
+    for (char c : prefix) {
+        auto it = nodes[n].next.find(c);
+        if (it == nodes[n].next.end()) return nullptr;
+        n = it->second;
+    }
+    return nodes[n].best < 0 ? nullptr : &entries[nodes[n].best];
+}